@@ -1,54 +1,190 @@
 #include "compiler/generator/pcode.h"
 
 #include <compiler/ast/ast_format.h>
+#include <compiler/ast/compile_cache.h>
 #include <compiler/ast/type_assign.h>
 #include <compiler/ast/type_format.h>
-#include <compiler/generator/llvm.h>
+#include <compiler/generator/compiler_session.h>
 #include <compiler/generator/pcode_gen.h>
 #include <compiler/parser/program.h>
 #include <cstdlib>
+#include <fmt/ranges.h>
 #include <gflags/gflags.h>
 #include <spdlog/spdlog.h>
+#include <thread>
 
 DEFINE_string(o, "a", "Output file");
 DEFINE_bool(pcode, true, "whether run pcode");
 DEFINE_bool(llvm, false, "whether run pcode");
+DEFINE_string(
+    cache_dir, "", "Keep per-function IR here and reuse it in later runs"
+);
+DEFINE_string(O, "0", "Optimization level: 0, 1, 2, 3, s or z");
+DEFINE_bool(
+    function_passes, false, "Also simplify each function as it is generated"
+);
 
-int RunLLVM(xi::Xi_Program ast, std::string output_obj, std::string output_ll)
+DEFINE_uint32(
+    codegen_threads,
+    1,
+    "Split the module and emit this many objects at once, 0 for one per core"
+);
+DEFINE_string(march, "", "CPU to generate for, native for this host");
+DEFINE_string(mcpu, "", "As --march, taking precedence over it");
+DEFINE_string(mattr, "", "Target features to add or remove, as +avx2,-fma");
+DEFINE_string(
+    alloc,
+    "malloc",
+    "Where arrays live at run time: malloc, or arena for a bump arena that "
+    "is never freed"
+);
+DEFINE_bool(
+    fast_math,
+    false,
+    "Let real arithmetic be reassociated and vectorized, as -ffast-math does"
+);
+
+DEFINE_bool(run, false, "JIT-compile and run main instead of linking");
+DEFINE_bool(lazy, true, "With --run, compile each function on its first call");
+
+// generate the module for ast and optimize it, returning the optimized IR
+auto GenerateLLVM(
+    xi::CompilerSession    &session,
+    xi::Xi_Program          ast,
+    xi::FunctionCache      &cache,
+    llvm::OptimizationLevel level
+) -> xi::ExpectedCodeGen<std::string>
+{
+    auto codegen_result = FLAGS_cache_dir.empty()
+                              ? session.CodeGen(ast)
+                              : session.CodeGen(ast, cache);
+    if (!FLAGS_cache_dir.empty())
+    {
+        auto stats = cache.GetStats();
+        spdlog::info(
+            "Cache: {} of {} functions reused",
+            stats.ir_hits,
+            stats.ir_hits + stats.ir_misses
+        );
+    }
+    return codegen_result >>= [&session, level](auto)
+    {
+        return session.Optimize(level);
+    };
+}
+
+int RunJIT(
+    xi::CompilerSession    &session,
+    xi::Xi_Program          ast,
+    xi::FunctionCache      &cache,
+    llvm::OptimizationLevel level
+)
+{
+    auto result = GenerateLLVM(session, std::move(ast), cache, level) >>=
+                  [&session](auto)
+    {
+        return session.JITRunMain(FLAGS_lazy);
+    };
+    if (!result)
+    {
+        spdlog::error("LLVM: \n {}\n", result.error().what());
+        return 1;
+    }
+    return static_cast<int>(result.value());
+}
+
+int RunLLVM(
+    xi::CompilerSession    &session,
+    xi::Xi_Program          ast,
+    xi::FunctionCache      &cache,
+    llvm::OptimizationLevel level,
+    std::string             output_obj,
+    std::string             output_ll
+)
 {
-    auto codegen_result = xi::CodeGen(ast);
-    if (!codegen_result)
+    auto optimized = GenerateLLVM(session, std::move(ast), cache, level);
+    if (!optimized)
     {
-        spdlog::error("LLVM: \n {}\n", codegen_result.error().what());
+        spdlog::error("LLVM: \n {}\n", optimized.error().what());
         return 1;
     }
     // write the IR to a file
     spdlog::info("Generate LLVM IR to {}", output_ll);
     std::ofstream ir_file(output_ll.data());
-    ir_file << codegen_result.value();
+    ir_file << optimized.value();
 
-    xi::GenObj(output_obj);
+    auto partitions = FLAGS_codegen_threads == 0
+                          ? std::max(1U, std::thread::hardware_concurrency())
+                          : FLAGS_codegen_threads;
+    auto objects    = session.GenObj(output_obj, partitions);
+    if (!objects)
+    {
+        spdlog::error("LLVM: \n {}\n", objects.error().what());
+        return 1;
+    }
+    spdlog::info("Wrote {}", fmt::join(objects.value(), " "));
 
-    // use clang to link the object file
+    // use clang to link the object files
     spdlog::info("Linking to {}", FLAGS_o);
-    auto clang_result =
-        std::system(fmt::format("clang {} -o {}", output_obj, FLAGS_o).c_str());
+    auto clang_result = std::system(
+        fmt::format("clang {} -o {}", fmt::join(objects.value(), " "), FLAGS_o)
+            .c_str()
+    );
+    // delete the object files
+    for (const auto &object : objects.value())
+    {
+        std::remove(object.data());
+    }
     if (clang_result != 0)
     {
-        // delete the object file
-        std::remove(output_obj.data());
         spdlog::error("Linking failed");
         return 1;
     }
-    std::remove(output_obj.data());
     spdlog::info("Linking successfully");
     return 0;
 }
 
 int main(int argc, char *argv[])
 {
+    // gflags would read -O2 as a flag named O2, spell it -O=2
+    auto args = std::vector<std::string>(argv, argv + argc);
+    for (auto &arg : args)
+    {
+        if (arg.size() > 2 && arg.starts_with("-O") && arg[2] != '=')
+        {
+            arg.insert(2, "=");
+        }
+    }
+    auto arg_ptrs = std::vector<char *>{};
+    for (auto &arg : args)
+    {
+        arg_ptrs.push_back(arg.data());
+    }
+    argv = arg_ptrs.data();
     gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+    auto level = xi::ParseOptLevel(FLAGS_O);
+    if (!level)
+    {
+        spdlog::error("Unknown optimization level -O{}", FLAGS_O);
+        return 1;
+    }
+    auto alloc_mode = xi::ParseAllocMode(FLAGS_alloc);
+    if (!alloc_mode)
+    {
+        spdlog::error("Unknown allocation mode --alloc={}", FLAGS_alloc);
+        return 1;
+    }
+    auto session = xi::CompilerSession(
+        xi::ParseTargetCPU(FLAGS_march, FLAGS_mcpu, FLAGS_mattr)
+    );
+    session.SetAllocMode(*alloc_mode);
+    session.SetFastMath(FLAGS_fast_math);
+    if (FLAGS_function_passes)
+    {
+        session.EnableFunctionPasses(*level);
+    }
+
     if (argc < 2)
     {
         spdlog::error("No input file specified");
@@ -75,7 +211,10 @@ int main(int argc, char *argv[])
             spdlog::info("Parse successfully\n");
             spdlog::info("AST:\n {}\n", ast_result.value().first);
             auto ast      = ast_result.value().first;
-            auto ast_type = TypeAssign(ast);
+            auto cache    = xi::FunctionCache{FLAGS_cache_dir};
+            auto ast_type = FLAGS_cache_dir.empty()
+                                ? session.TypeAssign(ast)
+                                : session.TypeAssign(ast, cache);
             if (!ast_type.has_value())
             {
                 spdlog::error("Type error {}\n", ast_type.error().what());
@@ -84,9 +223,15 @@ int main(int argc, char *argv[])
 
             spdlog::info("Type:\n {}\n", ast_type.value());
             spdlog::info("Ast With Type:\n {}\n", ast);
+            if (FLAGS_run)
+            {
+                return RunJIT(session, ast, cache, *level);
+            }
             if (FLAGS_llvm)
             {
-                return RunLLVM(ast, output_obj, output_ll);
+                return RunLLVM(
+                    session, ast, cache, *level, output_obj, output_ll
+                );
             }
             if (FLAGS_pcode)
             {
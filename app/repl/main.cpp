@@ -1,54 +1,76 @@
-#include <compiler/ast/ast_format.h>
-#include <compiler/generator/llvm.h>
+#include <algorithm>
+#include <cctype>
+#include <compiler/generator/jit_session.h>
+#include <compiler/parser/expr.h>
 #include <compiler/parser/program.h>
 #include <iostream>
 
+auto isBlank(std::string_view rest) -> bool
+{
+    return std::ranges::all_of(
+        rest,
+        [](char c)
+        {
+            return std::isspace(static_cast<unsigned char>(c)) != 0 ||
+                   c == ';';
+        }
+    );
+}
+
 int main()
 {
-    std::string total_input;
+    auto session = xi::JITSession::Create();
+    if (!session)
+    {
+        fmt::print("JIT: {}\n", session.error().what());
+        return 1;
+    }
+
+    std::string input;
     while (true)
     {
-        std::cout << "xi> ";
+        std::cout << (input.empty() ? "xi> " : "... ");
 
-        std::string input;
-        std::getline(std::cin, input);
-        if (std::cin.good())
+        std::string line;
+        if (!std::getline(std::cin, line))
         {
-            input += '\n';
+            return 0;
         }
-        if (input == "exit()")
+        if (input.empty() && line == "exit()")
         {
             return 0;
         }
-        total_input += input;
+        input += line + '\n';
 
-        auto total_result = xi::Xi_program(total_input);
-        if (total_result)
+        // each input is parsed and compiled on its own, everything before it
+        // already lives in the session; an input that does not parse yet
+        // continues on the next line, up to an empty one
+        auto definitions = xi::Xi_program(input);
+        auto expr        = xi::Xi_expr(input);
+        if (definitions && !definitions->first.stmts.empty() &&
+            isBlank(definitions->second))
         {
-            if (total_result.value().second == "\n")
-            {
-                fmt::print("Parse successfully\n");
-                fmt::print("AST:\n {}\n", total_result.value().first);
-                auto code_result = xi::CodeGen(total_result.value().first);
-                if (code_result)
-                {
-                    fmt::print("LLVM IR: \n {}\n", code_result.value());
-                }
-                else
-                {
-                    fmt::print("LLVM: \n {}\n", code_result.error().what());
-                }
-            }
-            else
+            auto defined = session->Define(definitions->first);
+            if (!defined)
             {
-                fmt::print(
-                    "Parse fail!\n {} not parsed\n", total_result.value().second
-                );
+                fmt::print("{}\n", defined.error().what());
             }
         }
-        else
+        else if (expr && isBlank(expr->second))
+        {
+            auto value = session->Evaluate(expr->first);
+            fmt::print(
+                "{}\n", value ? value.value() : value.error().what()
+            );
+        }
+        else if (!isBlank(line))
+        {
+            continue;
+        }
+        else if (!isBlank(input))
         {
             fmt::print("Failed to parse\n");
         }
+        input.clear();
     }
 }
@@ -2,6 +2,7 @@
 
 #include "compiler/ast/all.h"
 #include "compiler/ast/enum_format.h"
+#include "compiler/ast/visit.h"
 
 #include <fmt/core.h>
 #include <fmt/format.h>
@@ -70,9 +71,10 @@ template <>
 struct fmt::formatter<xi::Xi_Expr> : fmt::formatter<std::string>
 {
     template <typename FormatContext>
-    auto format(xi::Xi_Expr c, FormatContext &ctx) const -> decltype(ctx.out())
+    auto format(const xi::Xi_Expr &c, FormatContext &ctx) const
+        -> decltype(ctx.out())
     {
-        return std::visit(
+        return xi::Visit(
             [&](auto &&arg) -> decltype(auto)
             {
                 const auto expr = fmt::format("{}", arg);
@@ -238,8 +240,8 @@ struct fmt::formatter<xi::Xi_Stmt> : fmt::formatter<xi::Xi_Expr>
     template <typename FormatContext>
     auto format(const xi::Xi_Stmt &i, FormatContext &ctx) const
     {
-        return std::visit(
-            [&ctx](auto &&stmt)
+        return xi::Visit(
+            [&ctx](const auto &stmt)
             {
                 return fmt::format_to(ctx.out(), "Xi_Stmt {}", stmt);
             },
@@ -0,0 +1,105 @@
+#include "compiler/ast/compile_cache.h"
+
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+
+namespace xi
+{
+
+FunctionCache::FunctionCache(std::filesystem::path dir) : dir_(std::move(dir))
+{
+    if (!dir_.empty())
+    {
+        std::filesystem::create_directories(dir_);
+    }
+}
+
+auto FunctionCache::Find(Symbol name, Fingerprint fingerprint) const
+    -> const Entry *
+{
+    const auto *entry = entries_.find(name);
+    if (entry == nullptr || entry->fingerprint != fingerprint)
+    {
+        type_misses_++;
+        return nullptr;
+    }
+    type_hits_++;
+    return entry;
+}
+
+void FunctionCache::Store(Symbol name, Entry entry)
+{
+    entries_.insert_or_assign(name, std::move(entry));
+}
+
+auto FunctionCache::FingerprintOf(Symbol name) const
+    -> std::optional<Fingerprint>
+{
+    const auto *entry = entries_.find(name);
+    if (entry == nullptr)
+    {
+        return std::nullopt;
+    }
+    return entry->fingerprint;
+}
+
+auto FunctionCache::FindIR(Fingerprint key) -> std::optional<std::string>
+{
+    if (auto it = ir_.find(key); it != ir_.end())
+    {
+        ir_hits_++;
+        return it->second;
+    }
+    if (!dir_.empty())
+    {
+        auto file = std::ifstream{irPath(key)};
+        if (file)
+        {
+            auto ir = std::string{
+                std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>()};
+            ir_.emplace(key, ir);
+            ir_hits_++;
+            return ir;
+        }
+    }
+    ir_misses_++;
+    return std::nullopt;
+}
+
+void FunctionCache::StoreIR(Fingerprint key, std::string ir)
+{
+    if (!dir_.empty())
+    {
+        // written next to the final name and renamed, so a reader never sees
+        // half a file
+        auto path      = irPath(key);
+        auto temporary = path;
+        temporary += ".tmp";
+        {
+            auto file = std::ofstream{temporary};
+            file << ir;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary, path, ec);
+    }
+    ir_.insert_or_assign(key, std::move(ir));
+}
+
+auto FunctionCache::GetStats() const -> Stats
+{
+    return Stats{
+        .type_hits   = type_hits_,
+        .type_misses = type_misses_,
+        .ir_hits     = ir_hits_,
+        .ir_misses   = ir_misses_,
+    };
+}
+
+auto FunctionCache::irPath(Fingerprint key) const -> std::filesystem::path
+{
+    return dir_ / fmt::format("{:016x}.ll", key);
+}
+
+} // namespace xi
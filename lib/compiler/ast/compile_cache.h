@@ -0,0 +1,78 @@
+#pragma once
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/fingerprint.h"
+#include "compiler/ast/type.h"
+#include "compiler/utils/symbol.h"
+
+#include <atomic>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace xi
+{
+
+// Results of earlier compilations, one entry per function.
+//
+// An entry is reused only while the function's fingerprint is unchanged, so a
+// one-function edit redoes that function and the functions whose view of its
+// signature changed. Type assignment keeps the annotated body; code generation
+// keeps the function's IR as text, in memory and, given a directory, on disk
+// as <key>.ll for later runs. Code generation keys the IR by the fingerprint
+// mixed with what else shapes it, such as the generator's version. The IR is
+// taken before optimization, so it does not depend on how the module is later
+// compiled.
+class FunctionCache
+{
+  public:
+    struct Entry
+    {
+        Fingerprint   fingerprint;
+        Xi_Func       func;
+        type::Xi_Type type;
+    };
+
+    // how much work the cache saved, counted since construction
+    struct Stats
+    {
+        size_t type_hits   = 0;
+        size_t type_misses = 0;
+        size_t ir_hits     = 0;
+        size_t ir_misses   = 0;
+    };
+
+    explicit FunctionCache(std::filesystem::path dir = {});
+
+    FunctionCache(const FunctionCache &)                     = delete;
+    auto operator=(const FunctionCache &) -> FunctionCache & = delete;
+
+    // the checked body of name, if it was checked with this fingerprint;
+    // safe to call from several threads at once
+    [[nodiscard]] auto Find(Symbol name, Fingerprint fingerprint) const
+        -> const Entry *;
+    void Store(Symbol name, Entry entry);
+    // fingerprint of name as of the last type assignment
+    [[nodiscard]] auto FingerprintOf(Symbol name) const
+        -> std::optional<Fingerprint>;
+
+    auto FindIR(Fingerprint key) -> std::optional<std::string>;
+    void StoreIR(Fingerprint key, std::string ir);
+
+    [[nodiscard]] auto GetStats() const -> Stats;
+
+  private:
+    [[nodiscard]] auto irPath(Fingerprint key) const
+        -> std::filesystem::path;
+
+    SymbolMap<Entry>                             entries_;
+    std::unordered_map<Fingerprint, std::string> ir_;
+    std::filesystem::path                        dir_;
+    mutable std::atomic<size_t>                  type_hits_   = 0;
+    mutable std::atomic<size_t>                  type_misses_ = 0;
+    size_t                                       ir_hits_     = 0;
+    size_t                                       ir_misses_   = 0;
+};
+
+} // namespace xi
@@ -42,23 +42,28 @@ auto findTypeInSymbolTable(std::string_view name, SymbolType st)
         }
     }
 
+    return findInSymbolTable(Symbol{name}, st);
+}
+
+auto findInSymbolTable(Symbol name, SymbolType st) -> TypeAssignResult
+{
     if (st == SymbolType::All)
     {
         for (const auto &st_ : {SymbolType::Function, SymbolType::Type})
         {
-            auto it = GetSymbolTable().find({std::string(name), st_});
-            if (it != GetSymbolTable().end())
+            if (const auto *type = GetSymbolTable()[st_].find(name);
+                type != nullptr)
             {
-                return it->second;
+                return *type;
             }
         }
     }
     else
     {
-        if (auto type = GetSymbolTable().find({std::string(name), st});
-            type != GetSymbolTable().end())
+        if (const auto *type = GetSymbolTable()[st].find(name);
+            type != nullptr)
         {
-            return type->second;
+            return *type;
         }
     }
     return tl::make_unexpected(TypeAssignError{
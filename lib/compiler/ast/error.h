@@ -4,11 +4,14 @@
 #include "compiler/ast/type_format.h"
 #include "compiler/functional/monad.h"
 #include "compiler/utils/expected.h"
+#include "compiler/utils/scoped_table.h"
+#include "compiler/utils/symbol.h"
 
 #include <fmt/core.h>
 #include <fmt/std.h>
 #include <magic_enum.hpp>
 #include <string>
+#include <utility>
 
 namespace xi
 {
@@ -41,7 +44,7 @@ struct TypeAssignError
 template <typename T>
 using ExpectedTypeAssign  = tl::expected<T, TypeAssignError>;
 using TypeAssignResult    = tl::expected<type::Xi_Type, TypeAssignError>;
-using LocalVariableRecord = std::unordered_map<std::string, type::Xi_Type>;
+using LocalVariableRecord = ScopedTable<Symbol, type::Xi_Type>;
 
 template <typename T>
 struct unit_<ExpectedTypeAssign<T>>
@@ -56,28 +59,83 @@ enum class SymbolType
     All,
 };
 
-inline auto GetSymbolTable()
-    -> std::map<std::pair<std::string, SymbolType>, type::Xi_Type> &
+// global functions and types, one flat table per namespace
+struct SymbolTable
 {
-    static std::map<std::pair<std::string, SymbolType>, type::Xi_Type>
-        symbol_table{};
-    return symbol_table;
+    SymbolMap<type::Xi_Type> functions;
+    SymbolMap<type::Xi_Type> types;
+
+    auto operator[](SymbolType st) -> SymbolMap<type::Xi_Type> &
+    {
+        return st == SymbolType::Function ? functions : types;
+    }
+
+    void clear()
+    {
+        functions.clear();
+        types.clear();
+    }
+};
+
+// The global tables of one compilation. Type assignment reads and fills the
+// state current on its thread: the one a TypeAssignScope made current there,
+// else a single state shared by the whole process.
+struct TypeAssignState
+{
+    SymbolTable              symbols;
+    SymbolMap<type::Xi_Type> definitions;
+};
+
+inline auto currentTypeAssignState() -> TypeAssignState *&
+{
+    static TypeAssignState               shared;
+    static thread_local TypeAssignState *current = &shared;
+    return current;
+}
+
+// makes a state current on this thread until the scope ends
+class TypeAssignScope
+{
+  public:
+    explicit TypeAssignScope(TypeAssignState &state) :
+        previous_(std::exchange(currentTypeAssignState(), &state))
+    {
+    }
+    ~TypeAssignScope() { currentTypeAssignState() = previous_; }
+
+    TypeAssignScope(const TypeAssignScope &)                     = delete;
+    auto operator=(const TypeAssignScope &) -> TypeAssignScope & = delete;
+
+  private:
+    TypeAssignState *previous_;
+};
+
+inline auto GetTypeAssignState() -> TypeAssignState &
+{
+    return *currentTypeAssignState();
+}
+
+inline auto GetSymbolTable() -> SymbolTable &
+{
+    return GetTypeAssignState().symbols;
 }
 
-inline auto GetFunctionDefinitionTable()
-    -> std::unordered_map<std::string, type::Xi_Type> &
+inline auto GetFunctionDefinitionTable() -> SymbolMap<type::Xi_Type> &
 {
-    static std::unordered_map<std::string, type::Xi_Type> symbol_table;
-    return symbol_table;
+    return GetTypeAssignState().definitions;
 }
 
+// the function whose body is being checked, one per checking thread
 inline auto GetCurrentFuncType() -> type::function&
 {
-    static type::function func_type{};
+    static thread_local type::function func_type{};
     return func_type;
 }
 
 auto findTypeInSymbolTable(std::string_view name, SymbolType st)
     -> TypeAssignResult;
 
+// look up a declared function or set by its interned name
+auto findInSymbolTable(Symbol name, SymbolType st) -> TypeAssignResult;
+
 } // namespace xi
@@ -0,0 +1,250 @@
+#include "compiler/ast/escape.h"
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/tail_call.h"
+#include "compiler/ast/visit.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace xi
+{
+
+// What the analysis knows while it follows a value through one function:
+// which parameters of each analysed function escape, and the calls in tail
+// position that free the frame before they return, if the value lives there.
+struct EscapeScope
+{
+    const SymbolMap<std::vector<bool>> &params;
+    std::unordered_set<const Xi_Call *> tail_calls;
+    bool                                len_builtin;
+};
+
+auto isName(const Xi_Expr &expr, Symbol name) -> bool
+{
+    const auto *iden = std::get_if<recursive_wrapper<Xi_Iden>>(&expr);
+    return iden != nullptr && iden->get().name == name;
+}
+
+// whether a value passed as argument index of call is sure not to outlive it
+auto safeArgument(const Xi_Call &call, size_t index, const EscapeScope &scope)
+    -> bool
+{
+    if (scope.len_builtin && call.name == LenSymbol())
+    {
+        return true;
+    }
+    if (scope.tail_calls.contains(&call))
+    {
+        return false;
+    }
+    const auto *escapes = scope.params.find(call.name);
+    return escapes != nullptr && index < escapes->size() && !(*escapes)[index];
+}
+
+// whether the value called name may outlive the function through expr
+auto escapes(Symbol name, const Xi_Expr &expr, const EscapeScope &scope)
+    -> bool
+{
+    auto through = [name, &scope](const Xi_Expr &child)
+    {
+        return escapes(name, child, scope);
+    };
+    return Visit(
+        [name, &scope, &through]<typename T>(const T &node) -> bool
+        {
+            if constexpr (std::same_as<T, Xi_Iden>)
+            {
+                return node.name == name;
+            }
+            else if constexpr (std::same_as<T, Xi_ArrayIndex>)
+            {
+                return through(node.index);
+            }
+            else if constexpr (std::same_as<T, Xi_Call>)
+            {
+                for (size_t i = 0; i < node.args.size(); i++)
+                {
+                    if (isName(node.args[i], name)
+                            ? !safeArgument(node, i, scope)
+                            : through(node.args[i]))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            else if constexpr (std::same_as<T, Xi_If>)
+            {
+                return through(node.cond) || through(node.then) ||
+                       through(node.els);
+            }
+            else if constexpr (std::same_as<T, Xi_Binop>)
+            {
+                return through(node.lhs) || through(node.rhs);
+            }
+            else if constexpr (std::same_as<T, Xi_Unop>)
+            {
+                return through(node.expr);
+            }
+            else if constexpr (std::same_as<T, Xi_Array>)
+            {
+                return std::ranges::any_of(node.elements, through);
+            }
+            else if constexpr (std::same_as<T, Xi_Lam> ||
+                               std::same_as<T, Xi_Assign>)
+            {
+                return true;
+            }
+            return false;
+        },
+        expr
+    );
+}
+
+auto escapesFunc(Symbol name, const Xi_Func &func, const EscapeScope &scope)
+    -> bool
+{
+    return escapes(name, func.expr, scope) ||
+           std::ranges::any_of(
+               func.let_idens,
+               [name, &scope](const Xi_Iden &let)
+               {
+                   return escapes(name, let.expr, scope);
+               }
+           );
+}
+
+// add the array literals of expr passed straight to a parameter that keeps
+// them within the call
+void collectArguments(
+    const Xi_Expr                        &expr,
+    const EscapeScope                    &scope,
+    std::unordered_set<const Xi_Array *> &arrays
+)
+{
+    auto collect = [&scope, &arrays](const Xi_Expr &child)
+    {
+        collectArguments(child, scope, arrays);
+    };
+    Visit(
+        [&scope, &arrays, &collect]<typename T>(const T &node)
+        {
+            if constexpr (std::same_as<T, Xi_Call>)
+            {
+                for (size_t i = 0; i < node.args.size(); i++)
+                {
+                    const auto *array =
+                        std::get_if<recursive_wrapper<Xi_Array>>(&node.args[i]);
+                    if (array != nullptr && safeArgument(node, i, scope))
+                    {
+                        arrays.insert(&array->get());
+                    }
+                    collect(node.args[i]);
+                }
+            }
+            else if constexpr (std::same_as<T, Xi_ArrayIndex>)
+            {
+                collect(node.index);
+            }
+            else if constexpr (std::same_as<T, Xi_If>)
+            {
+                collect(node.cond);
+                collect(node.then);
+                collect(node.els);
+            }
+            else if constexpr (std::same_as<T, Xi_Binop>)
+            {
+                collect(node.lhs);
+                collect(node.rhs);
+            }
+            else if constexpr (std::same_as<T, Xi_Unop>)
+            {
+                collect(node.expr);
+            }
+            else if constexpr (std::same_as<T, Xi_Array>)
+            {
+                std::ranges::for_each(node.elements, collect);
+            }
+        },
+        expr
+    );
+}
+
+auto NonEscapingArrays(const Xi_Program &program)
+    -> std::unordered_set<const Xi_Array *>
+{
+    auto functions   = std::vector<const Xi_Func *>{};
+    auto len_is_free = true;
+    for (const auto &stmt : program.stmts)
+    {
+        const auto *func = std::get_if<recursive_wrapper<Xi_Func>>(&stmt);
+        if (func != nullptr && func->get().expr != std::monostate{})
+        {
+            functions.push_back(&func->get());
+        }
+        const auto *decl = std::get_if<Xi_Decl>(&stmt);
+        if (decl != nullptr && decl->name == LenSymbol())
+        {
+            len_is_free = false;
+        }
+    }
+
+    // no parameter escapes until a use is found that lets it, so recursive
+    // functions passing a parameter along to themselves keep it
+    auto params = SymbolMap<std::vector<bool>>{};
+    for (const auto *func : functions)
+    {
+        params.insert_or_assign(
+            func->name, std::vector<bool>(func->params.size(), false)
+        );
+    }
+    auto param_scope = EscapeScope{
+        .params      = params,
+        .tail_calls  = {},
+        .len_builtin = len_is_free,
+    };
+    for (auto changed = true; changed;)
+    {
+        changed = false;
+        for (const auto *func : functions)
+        {
+            auto &escaped = *params.find(func->name);
+            for (size_t i = 0; i < func->params.size(); i++)
+            {
+                if (!escaped[i] &&
+                    escapesFunc(func->params[i], *func, param_scope))
+                {
+                    escaped[i] = true;
+                    changed    = true;
+                }
+            }
+        }
+    }
+
+    // a literal in this frame is gone once a tail call starts
+    auto arrays = std::unordered_set<const Xi_Array *>{};
+    for (const auto *func : functions)
+    {
+        auto tail_calls = TailCalls(*func);
+        auto scope      = EscapeScope{
+            .params      = params,
+            .tail_calls  = {tail_calls.begin(), tail_calls.end()},
+            .len_builtin = len_is_free,
+        };
+        for (const auto &let : func->let_idens)
+        {
+            const auto *array =
+                std::get_if<recursive_wrapper<Xi_Array>>(&let.expr);
+            if (array != nullptr && !escapesFunc(let.name, *func, scope))
+            {
+                arrays.insert(&array->get());
+            }
+            collectArguments(let.expr, scope, arrays);
+        }
+        collectArguments(func->expr, scope, arrays);
+    }
+    return arrays;
+}
+
+} // namespace xi
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <unordered_set>
+
+namespace xi
+{
+
+struct Xi_Program;
+struct Xi_Array;
+
+// The array literals in the expression functions of program that never outlive
+// the call that creates them, so they can live in its stack frame.
+//
+// A literal qualifies when it is bound by a let or passed straight to a call,
+// and from there is only indexed, measured with len, or passed outside tail
+// position to a parameter that does not escape either. A parameter escapes
+// when its function returns it, puts it into another value, or passes it to a
+// parameter that escapes; functions known only by a declaration let all their
+// parameters escape. Statement functions are not analysed.
+auto NonEscapingArrays(const Xi_Program &program)
+    -> std::unordered_set<const Xi_Array *>;
+
+} // namespace xi
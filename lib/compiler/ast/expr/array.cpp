@@ -8,7 +8,7 @@ namespace xi
 
 auto TypeAssign(Xi_Array &arr, LocalVariableRecord record) -> TypeAssignResult
 {
-    return flatmap(
+    return traverse(
                arr.elements,
                [record](Xi_Expr &expr)
                {
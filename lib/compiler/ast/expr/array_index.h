@@ -11,7 +11,7 @@ namespace xi
 
 struct Xi_ArrayIndex
 {
-    std::string   array_var_name;
+    Symbol        array_var_name;
     Xi_Expr       index;
     type::Xi_Type type = type::unknown{};
 };
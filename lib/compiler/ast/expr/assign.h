@@ -8,7 +8,7 @@ namespace xi
 
 struct Xi_Assign
 {
-    std::string   name;
+    Symbol        name;
     Xi_Expr       expr;
     type::Xi_Type type = type::unknown{};
 };
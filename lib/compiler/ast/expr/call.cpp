@@ -11,15 +11,29 @@ namespace xi
 auto TypeAssign(Xi_Call& call_expr, LocalVariableRecord record)
     -> TypeAssignResult
 {
-    return flatmap_(
+    return traverse(
                call_expr.args,
                [record](auto &x)
                {
                    return TypeAssign(x, record);
                }
-           ) >>= [&call_expr, record](auto args_type)
+           ) >>= [&call_expr, record](auto args_type) -> TypeAssignResult
     {
-        return findTypeInSymbolTable(call_expr.name, SymbolType::Function) >>=
+        if (IsLenBuiltin(call_expr.name))
+        {
+            if (args_type.size() != 1 ||
+                !std::holds_alternative<recursive_wrapper<type::array>>(
+                    args_type.front()
+                ))
+            {
+                return tl::make_unexpected(TypeAssignError{
+                    TypeAssignError::TypeMismatch,
+                    fmt::format("len takes an array, find {}", args_type),
+                });
+            }
+            return call_expr.type = type::i64{};
+        }
+        return findInSymbolTable(call_expr.name, SymbolType::Function) >>=
                [args_type, &call_expr, record](auto func_type
                ) -> TypeAssignResult
         {
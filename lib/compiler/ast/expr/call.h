@@ -5,6 +5,7 @@
 #include "compiler/ast/type.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace xi
@@ -12,7 +13,7 @@ namespace xi
 
 struct Xi_Call
 {
-    std::string          name;
+    Symbol               name;
     std::vector<Xi_Expr> args;
     type::Xi_Type        type = type::unknown{};
 };
@@ -27,6 +28,23 @@ inline auto operator<=>(const Xi_Call &lhs, const Xi_Call &rhs)
     return lhs.name <=> rhs.name;
 }
 
+// len @ xs is the number of elements of the array xs. A declared function
+// named len takes the place of the builtin.
+inline constexpr std::string_view len_builtin = "len";
+
+// len_builtin interned once, so names are checked against it by id
+inline auto LenSymbol() -> Symbol
+{
+    static const auto len = Symbol{len_builtin};
+    return len;
+}
+
+inline auto IsLenBuiltin(Symbol name) -> bool
+{
+    return name == LenSymbol() &&
+           !GetSymbolTable()[SymbolType::Function].contains(name);
+}
+
 auto TypeAssign(Xi_Call& call_expr, LocalVariableRecord record)
     -> TypeAssignResult;
 
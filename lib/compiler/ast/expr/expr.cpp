@@ -2,14 +2,15 @@
 
 #include "compiler/ast/all.h"
 #include "compiler/ast/type_assign.h"
+#include "compiler/ast/visit.h"
 
 namespace xi
 {
 
 auto TypeAssign(Xi_Expr &expr, LocalVariableRecord record) -> TypeAssignResult
 {
-    return std::visit(
-        [record](auto &expr_) mutable
+    return Visit(
+        [&record](auto &expr_)
         {
             return TypeAssign(expr_, record);
         },
@@ -9,13 +9,13 @@ namespace xi
 auto TypeAssign(Xi_Iden &iden, LocalVariableRecord record) -> TypeAssignResult
 {
     auto iden_type = record.find(iden.name);
-    if (iden_type == record.end())
+    if (iden_type == nullptr)
     {
         return tl::make_unexpected(TypeAssignError{
             TypeAssignError::UnknownVariable,
             fmt::format("undeclared variable {}", iden.name),
         });
     }
-    return iden.type = iden_type->second;
+    return iden.type = *iden_type;
 }
 } // namespace xi
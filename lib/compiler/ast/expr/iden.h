@@ -11,10 +11,11 @@ namespace xi
 
 struct Xi_Iden
 {
-    std::string   name;
+    Symbol        name;
     Xi_Expr       expr;
     type::Xi_Type type = type::unknown{};
                   operator std::string() const { return name; }
+                  operator Symbol() const { return name; }
     auto          operator==(const Xi_Iden &b) const -> bool
     {
         return *this <=> b == nullptr;
@@ -1,14 +1,13 @@
 #include "compiler/ast/expr/lam.h"
 
 #include "compiler/ast/all.h"
+#include "compiler/ast/infer.h"
 
 namespace xi
 {
 
-auto TypeAssign(Xi_Lam & /*unused*/, LocalVariableRecord /*unused*/)
-    -> TypeAssignResult
+auto TypeAssign(Xi_Lam &lam, LocalVariableRecord record) -> TypeAssignResult
 {
-    return tl::make_unexpected(TypeAssignError{
-        TypeAssignError::TypeMismatch, "not implemented",});
+    return InferLam(lam, std::move(record));
 }
 } // namespace xi
@@ -24,7 +24,7 @@ inline auto operator<=>(const Xi_Lam &lhs, const Xi_Lam &rhs)
     return lhs.body <=> rhs.body;
 }
 
-auto TypeAssign(Xi_Lam & /*unused*/, LocalVariableRecord /*unused*/)
-    -> TypeAssignResult;
+// parameter and body types are inferred, see InferState
+auto TypeAssign(Xi_Lam &lam, LocalVariableRecord record) -> TypeAssignResult;
 
 } // namespace xi
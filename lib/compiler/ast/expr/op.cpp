@@ -36,12 +36,13 @@ auto typeAssignDot(Xi_Binop &binop, LocalVariableRecord record)
         auto set_type = std::get<recursive_wrapper<type::set>>(lhs_type);
         auto member_name =
             std::get<recursive_wrapper<Xi_Iden>>(binop.rhs).get().name;
-        auto member_type = std::find_if(
+        const auto &member_text = member_name.str();
+        auto        member_type = std::find_if(
             set_type.get().members.begin(),
             set_type.get().members.end(),
-            [&member_name](auto member)
+            [&member_text](const auto &member)
             {
-                return member.first == member_name;
+                return member.first == member_text;
             }
         );
         if (member_type == set_type.get().members.end())
@@ -186,12 +187,12 @@ auto TypeAssign(Xi_Unop &unop, LocalVariableRecord record) -> TypeAssignResult
             {
                 return tl::make_unexpected(TypeAssignError{
                     TypeAssignError::TypeMismatch,
-                    fmt::format("expect i64, has {}", expr_type),
+                    fmt::format("expect i64 or real, has {}", expr_type),
                 });
             }
             else
             {
-                return unop.type = type::i64{};
+                return unop.type = expr_type;
             }
         case Xi_Op::Not:
             if (expr_type != type::buer{})
@@ -0,0 +1,347 @@
+#include "compiler/ast/fingerprint.h"
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/visit.h"
+
+#include <algorithm>
+#include <bit>
+#include <string_view>
+
+namespace xi
+{
+
+// Walks the syntax of a function once, folding it into a 64-bit FNV-1a hash
+// and collecting the names it mentions. Every node mixes its variant index
+// and every list its length, so different trees cannot hash the same bytes.
+struct FingerprintWalker
+{
+    static constexpr uint64_t fnv_offset = 14695981039346656037ULL;
+    static constexpr uint64_t fnv_prime  = 1099511628211ULL;
+
+    uint64_t            hash = fnv_offset;
+    std::vector<Symbol> references;
+
+    void mix(std::string_view bytes)
+    {
+        mix(bytes.size());
+        for (auto byte : bytes)
+        {
+            hash ^= static_cast<uint8_t>(byte);
+            hash *= fnv_prime;
+        }
+    }
+
+    void mix(uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            hash ^= value & 0xffU;
+            hash *= fnv_prime;
+            value >>= 8U;
+        }
+    }
+
+    void mix(Symbol name) { mix(std::string_view{name.str()}); }
+
+    void refer(Symbol name) { references.push_back(name); }
+
+    void mixType(const type::Xi_Type &xi_type)
+    {
+        mix(xi_type.index());
+        Visit(
+            [this]<typename T>(const T &t)
+            {
+                if constexpr (std::same_as<T, type::array>)
+                {
+                    mixType(t.inner_type);
+                }
+                else if constexpr (std::same_as<T, type::function>)
+                {
+                    mixType(t.return_type);
+                    mixAll(t.param_types, &FingerprintWalker::mixType);
+                    mix(static_cast<uint64_t>(t.is_vararg));
+                }
+                else if constexpr (std::same_as<T, type::set>)
+                {
+                    mix(std::string_view{t.name});
+                    mix(t.members.size());
+                    for (const auto &[name, member] : t.members)
+                    {
+                        mix(std::string_view{name});
+                        mixType(member);
+                    }
+                }
+                else if constexpr (std::same_as<T, type::types>)
+                {
+                    mixAll(t.types_, &FingerprintWalker::mixType);
+                }
+            },
+            xi_type
+        );
+    }
+
+    template <typename T, typename F>
+    void mixAll(const std::vector<T> &items, F walker)
+    {
+        mix(items.size());
+        for (const auto &item : items)
+        {
+            (this->*walker)(item);
+        }
+    }
+
+    void walk(const Xi_Expr &expr)
+    {
+        mix(expr.index());
+        Visit(
+            [this](const auto &node)
+            {
+                walkNode(node);
+            },
+            expr
+        );
+    }
+
+    void walk(const Xi_Stmt &stmt)
+    {
+        mix(stmt.index());
+        Visit(
+            [this](const auto &node)
+            {
+                walkNode(node);
+            },
+            stmt
+        );
+    }
+
+    void walkExprs(const std::vector<Xi_Expr> &exprs)
+    {
+        mix(exprs.size());
+        for (const auto &expr : exprs)
+        {
+            walk(expr);
+        }
+    }
+
+    void walkStmts(const std::vector<Xi_Stmt> &stmts)
+    {
+        mix(stmts.size());
+        for (const auto &stmt : stmts)
+        {
+            walk(stmt);
+        }
+    }
+
+    void walkNode(std::monostate /*unused*/) {}
+    void walkNode(const Xi_Integer &integer)
+    {
+        mix(static_cast<uint64_t>(integer.value));
+    }
+    void walkNode(const Xi_Boolean &boolean)
+    {
+        mix(static_cast<uint64_t>(boolean.value));
+    }
+    void walkNode(const Xi_Real &real)
+    {
+        mix(std::bit_cast<uint64_t>(real.value));
+    }
+    void walkNode(const Xi_String &s) { mix(std::string_view{s.value}); }
+
+    void walkNode(const Xi_ArrayIndex &index)
+    {
+        refer(index.array_var_name);
+        mix(index.array_var_name);
+        walk(index.index);
+    }
+
+    void walkNode(const Xi_Iden &iden)
+    {
+        // an identifier with no expression is a use, with one a let binding
+        if (iden.expr == std::monostate{})
+        {
+            refer(iden.name);
+        }
+        mix(iden.name);
+        walk(iden.expr);
+    }
+
+    void walkNode(const Xi_Unop &uop)
+    {
+        mix(static_cast<uint64_t>(uop.op));
+        walk(uop.expr);
+    }
+
+    void walkNode(const Xi_Binop &bop)
+    {
+        mix(static_cast<uint64_t>(bop.op));
+        walk(bop.lhs);
+        walk(bop.rhs);
+    }
+
+    void walkNode(const Xi_If &if_expr)
+    {
+        walk(if_expr.cond);
+        walk(if_expr.then);
+        walk(if_expr.els);
+    }
+
+    void walkNode(const Xi_Lam &lam)
+    {
+        mix(lam.args.size());
+        for (const auto &arg : lam.args)
+        {
+            mix(arg.name);
+        }
+        walk(lam.body);
+    }
+
+    void walkNode(const Xi_Call &call)
+    {
+        refer(call.name);
+        mix(call.name);
+        walkExprs(call.args);
+    }
+
+    void walkNode(const Xi_Array &arr) { walkExprs(arr.elements); }
+
+    void walkNode(const Xi_Assign &assign)
+    {
+        refer(assign.name);
+        mix(assign.name);
+        walk(assign.expr);
+    }
+
+    void walkNode(const Xi_Decl &decl)
+    {
+        mix(decl.name);
+        mix(std::string_view{decl.return_type});
+        mix(decl.params_type.size());
+        for (const auto &param : decl.params_type)
+        {
+            mix(std::string_view{param});
+        }
+        mix(static_cast<uint64_t>(decl.is_vararg));
+    }
+
+    void walkNode(const Xi_Set &set)
+    {
+        mix(set.name);
+        mix(set.members.size());
+        for (const auto &[name, type_name] : set.members)
+        {
+            refer(type_name);
+            mix(std::string_view{name});
+            mix(std::string_view{type_name});
+        }
+    }
+
+    // comments never reach the output
+    void walkNode(const Xi_Comment & /*unused*/) {}
+
+    void walkNode(const Xi_Return &ret) { walk(ret.expr); }
+
+    void walkNode(const Xi_Var &var)
+    {
+        refer(var.type_name);
+        mix(var.name);
+        mix(std::string_view{var.type_name});
+        walk(var.value);
+    }
+
+    void walkNode(const Xi_If_stmt &if_stmt)
+    {
+        walk(if_stmt.cond);
+        walkStmts(if_stmt.then);
+        walkStmts(if_stmt.els);
+    }
+
+    void walkNode(const Xi_While &wle)
+    {
+        walk(wle.cond);
+        walkStmts(wle.body);
+    }
+
+    void walkNode(const Xi_Stmts &stmts) { walkStmts(stmts.stmts); }
+
+    void walkNode(const Xi_Expr &expr) { walk(expr); }
+
+    void walkNode(const Xi_Func &func)
+    {
+        refer(func.name);
+        mix(func.name);
+        mix(func.params.size());
+        for (const auto &param : func.params)
+        {
+            mix(param);
+        }
+        mix(func.let_idens.size());
+        for (const auto &let_iden : func.let_idens)
+        {
+            walkNode(let_iden);
+        }
+        walk(func.expr);
+        walkStmts(func.stmts);
+    }
+
+    // sorted by text, not id: ids depend on the order names were interned
+    auto sortedReferences() -> std::vector<Symbol>
+    {
+        std::sort(
+            references.begin(),
+            references.end(),
+            [](Symbol lhs, Symbol rhs)
+            {
+                return lhs.str() < rhs.str();
+            }
+        );
+        references.erase(
+            std::unique(references.begin(), references.end()), references.end()
+        );
+        return references;
+    }
+};
+
+auto References(const Xi_Func &func) -> std::vector<Symbol>
+{
+    auto walker = FingerprintWalker{};
+    walker.walkNode(func);
+    return walker.sortedReferences();
+}
+
+auto FunctionFingerprint(const Xi_Func &func, const LocalVariableRecord &record)
+    -> Fingerprint
+{
+    auto walker = FingerprintWalker{};
+    walker.walkNode(func);
+    // a name may be a function, a type and a variable at once, so each
+    // table is mixed in; an absent binding mixes a different tag than any
+    // type
+    auto mixBinding = [&walker](const type::Xi_Type *found)
+    {
+        if (found == nullptr)
+        {
+            walker.mix(uint64_t{0});
+            return;
+        }
+        walker.mix(uint64_t{1});
+        walker.mixType(*found);
+    };
+    for (auto name : walker.sortedReferences())
+    {
+        walker.mix(name);
+        mixBinding(GetSymbolTable().functions.find(name));
+        mixBinding(GetSymbolTable().types.find(name));
+        mixBinding(record.find(name));
+    }
+    return walker.hash;
+}
+
+auto MixFingerprint(Fingerprint fingerprint, uint64_t value) -> Fingerprint
+{
+    auto walker = FingerprintWalker{};
+    walker.hash = fingerprint;
+    walker.mix(value);
+    return walker.hash;
+}
+
+} // namespace xi
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "compiler/ast/error.h"
+#include "compiler/utils/symbol.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace xi
+{
+
+struct Xi_Func;
+
+// stable across runs, so it can name cache entries on disk
+using Fingerprint = uint64_t;
+
+// names a function mentions that may resolve to a global: callees,
+// variables and type names, sorted by text and without duplicates
+auto References(const Xi_Func &func) -> std::vector<Symbol>;
+
+// Hash of everything type assignment and code generation read for func: its
+// own syntax (types excluded, comments skipped) and the declared type of each
+// global in References, including its own declaration. A body edit changes
+// only that function's fingerprint; a signature change also changes the
+// fingerprint of every function that refers to it.
+auto FunctionFingerprint(const Xi_Func &func, const LocalVariableRecord &record)
+    -> Fingerprint;
+
+// fingerprint with value folded in, for keys that also depend on how a
+// function is compiled
+auto MixFingerprint(Fingerprint fingerprint, uint64_t value) -> Fingerprint;
+
+} // namespace xi
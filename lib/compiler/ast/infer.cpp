@@ -0,0 +1,905 @@
+#include "compiler/ast/infer.h"
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/ast_format.h"
+#include "compiler/ast/visit.h"
+
+#include <algorithm>
+#include <string>
+
+namespace xi
+{
+
+auto kindOf(const type::Xi_Type &xi_type) -> uint8_t
+{
+    if (std::holds_alternative<type::i64>(xi_type))
+    {
+        return InferState::I64;
+    }
+    if (std::holds_alternative<type::real>(xi_type))
+    {
+        return InferState::Real;
+    }
+    if (std::holds_alternative<type::buer>(xi_type))
+    {
+        return InferState::Buer;
+    }
+    if (std::holds_alternative<type::string>(xi_type))
+    {
+        return InferState::String;
+    }
+    return InferState::Other;
+}
+
+auto describeKinds(uint8_t allowed) -> std::string
+{
+    static constexpr auto names =
+        std::array<std::pair<uint8_t, const char *>, 5>{{
+            {InferState::I64, "i64"},
+            {InferState::Real, "real"},
+            {InferState::Buer, "buer"},
+            {InferState::String, "string"},
+            {InferState::Other, "compound type"},
+        }};
+    auto description = std::string{};
+    for (const auto &[kind, name] : names)
+    {
+        if ((allowed & kind) != 0)
+        {
+            description += description.empty() ? "" : " or ";
+            description += name;
+        }
+    }
+    return description;
+}
+
+InferState::InferState(LocalVariableRecord record) : record_(std::move(record))
+{
+    builtins_ = {
+        push(Node{.tag = Node::Con, .ground = type::i64{}}),
+        push(Node{.tag = Node::Con, .ground = type::real{}}),
+        push(Node{.tag = Node::Con, .ground = type::buer{}}),
+        push(Node{.tag = Node::Con, .ground = type::string{}}),
+    };
+}
+
+auto InferState::push(Node node) -> TypeId
+{
+    auto id     = static_cast<TypeId>(nodes_.size());
+    node.parent = id;
+    node.level  = level_;
+    nodes_.push_back(std::move(node));
+    return id;
+}
+
+auto InferState::Fresh(uint8_t allowed) -> TypeId
+{
+    return push(Node{.tag = Node::Var, .allowed = allowed});
+}
+
+auto InferState::Function(TypeId ret, const std::vector<TypeId> &params)
+    -> TypeId
+{
+    auto children = std::vector<TypeId>{};
+    children.reserve(params.size() + 1);
+    children.push_back(ret);
+    children.insert(children.end(), params.begin(), params.end());
+    return push(Node{.tag = Node::Fun, .children = std::move(children)});
+}
+
+auto InferState::Array(TypeId element) -> TypeId
+{
+    return push(Node{.tag = Node::Arr, .children = {element}});
+}
+
+auto InferState::Builtin(Kind kind) const -> TypeId
+{
+    switch (kind)
+    {
+    case Real:
+        return builtins_[1];
+    case Buer:
+        return builtins_[2];
+    case String:
+        return builtins_[3];
+    default:
+        return builtins_[0];
+    }
+}
+
+auto InferState::FromType(const type::Xi_Type &xi_type) -> TypeId
+{
+    return std::visit(
+        [this]<typename T>(const T &t) -> TypeId
+        {
+            if constexpr (std::same_as<T, type::unknown>)
+            {
+                return Fresh();
+            }
+            else if constexpr (std::same_as<T, recursive_wrapper<type::array>>)
+            {
+                return Array(FromType(t.get().inner_type));
+            }
+            else if constexpr (std::same_as<
+                                   T,
+                                   recursive_wrapper<type::function>>)
+            {
+                auto ret    = FromType(t.get().return_type);
+                auto params = std::vector<TypeId>{};
+                params.reserve(t.get().param_types.size());
+                for (const auto &param : t.get().param_types)
+                {
+                    params.push_back(FromType(param));
+                }
+                auto id              = Function(ret, params);
+                nodes_[id].is_vararg = t.get().is_vararg;
+                return id;
+            }
+            else if constexpr (std::same_as<T, type::i64>)
+            {
+                return Builtin(I64);
+            }
+            else if constexpr (std::same_as<T, type::real>)
+            {
+                return Builtin(Real);
+            }
+            else if constexpr (std::same_as<T, type::buer>)
+            {
+                return Builtin(Buer);
+            }
+            else if constexpr (std::same_as<T, type::string>)
+            {
+                return Builtin(String);
+            }
+            else
+            {
+                return push(Node{.tag = Node::Con, .ground = t});
+            }
+        },
+        xi_type
+    );
+}
+
+auto InferState::Find(TypeId id) -> TypeId
+{
+    // path halving: every other node on the path skips to its grandparent
+    while (nodes_[id].parent != id)
+    {
+        nodes_[id].parent = nodes_[nodes_[id].parent].parent;
+        id                = nodes_[id].parent;
+    }
+    return id;
+}
+
+auto InferState::link(TypeId from, TypeId to) -> TypeId
+{
+    nodes_[from].parent = to;
+    nodes_[to].rank     = std::max(nodes_[to].rank, nodes_[from].rank + 1);
+    return to;
+}
+
+auto InferState::mismatch(TypeId lhs, TypeId rhs) -> TypeAssignError
+{
+    return TypeAssignError{
+        TypeAssignError::TypeMismatch,
+        fmt::format("expect {}, find {}", Resolve(lhs), Resolve(rhs)),
+    };
+}
+
+auto InferState::occursAdjust(TypeId var, TypeId term, uint32_t level) -> bool
+{
+    term = Find(term);
+    if (term == var)
+    {
+        return true;
+    }
+    auto &node = nodes_[term];
+    if (node.tag == Node::Var)
+    {
+        node.level = std::min(node.level, level);
+        return false;
+    }
+    return std::ranges::any_of(
+        node.children,
+        [this, var, level](TypeId child)
+        {
+            return occursAdjust(var, child, level);
+        }
+    );
+}
+
+auto InferState::bindVar(TypeId var, TypeId term) -> ExpectedTypeAssign<TypeId>
+{
+    const auto   &node = nodes_[term];
+    const uint8_t kind =
+        node.tag == Node::Con ? kindOf(node.ground) : uint8_t{Other};
+    if ((nodes_[var].allowed & kind) == 0)
+    {
+        return tl::make_unexpected(TypeAssignError{
+            TypeAssignError::TypeMismatch,
+            fmt::format(
+                "expect {}, find {}",
+                describeKinds(nodes_[var].allowed),
+                Resolve(term)
+            ),
+        });
+    }
+    if (occursAdjust(var, term, nodes_[var].level))
+    {
+        return tl::make_unexpected(TypeAssignError{
+            TypeAssignError::TypeMismatch,
+            fmt::format("infinite type {}", Resolve(term)),
+        });
+    }
+    return link(var, term);
+}
+
+auto InferState::Unify(TypeId lhs, TypeId rhs) -> ExpectedTypeAssign<TypeId>
+{
+    lhs = Find(lhs);
+    rhs = Find(rhs);
+    if (lhs == rhs)
+    {
+        return lhs;
+    }
+
+    auto lhs_tag = nodes_[lhs].tag;
+    auto rhs_tag = nodes_[rhs].tag;
+    if (lhs_tag == Node::Var && rhs_tag == Node::Var)
+    {
+        auto allowed = static_cast<uint8_t>(
+            nodes_[lhs].allowed & nodes_[rhs].allowed
+        );
+        if (allowed == 0)
+        {
+            return tl::make_unexpected(mismatch(lhs, rhs));
+        }
+        auto level = std::min(nodes_[lhs].level, nodes_[rhs].level);
+        auto root  = nodes_[lhs].rank < nodes_[rhs].rank ? link(lhs, rhs)
+                                                         : link(rhs, lhs);
+        nodes_[root].allowed = allowed;
+        nodes_[root].level   = level;
+        return root;
+    }
+    if (lhs_tag == Node::Var)
+    {
+        return bindVar(lhs, rhs);
+    }
+    if (rhs_tag == Node::Var)
+    {
+        return bindVar(rhs, lhs);
+    }
+    if (lhs_tag != rhs_tag ||
+        nodes_[lhs].children.size() != nodes_[rhs].children.size() ||
+        nodes_[lhs].is_vararg != nodes_[rhs].is_vararg)
+    {
+        return tl::make_unexpected(mismatch(lhs, rhs));
+    }
+    if (lhs_tag == Node::Con)
+    {
+        if (nodes_[lhs].ground != nodes_[rhs].ground)
+        {
+            return tl::make_unexpected(mismatch(lhs, rhs));
+        }
+        return lhs;
+    }
+    for (size_t i = 0; i < nodes_[lhs].children.size(); i++)
+    {
+        auto child = Unify(nodes_[lhs].children[i], nodes_[rhs].children[i]);
+        if (!child.has_value())
+        {
+            return child;
+        }
+    }
+    return nodes_[lhs].rank < nodes_[rhs].rank ? link(lhs, rhs)
+                                               : link(rhs, lhs);
+}
+
+auto InferState::Constrain(TypeId id, uint8_t allowed)
+    -> ExpectedTypeAssign<TypeId>
+{
+    id         = Find(id);
+    auto &node = nodes_[id];
+    if (node.tag == Node::Var && (node.allowed & allowed) != 0)
+    {
+        node.allowed = static_cast<uint8_t>(node.allowed & allowed);
+        return id;
+    }
+    if (node.tag == Node::Con && (kindOf(node.ground) & allowed) != 0)
+    {
+        return id;
+    }
+    if ((node.tag == Node::Fun || node.tag == Node::Arr) &&
+        (allowed & Other) != 0)
+    {
+        return id;
+    }
+    return tl::make_unexpected(TypeAssignError{
+        TypeAssignError::TypeMismatch,
+        fmt::format("expect {}, find {}", describeKinds(allowed), Resolve(id)),
+    });
+}
+
+auto InferState::Resolve(TypeId id) -> type::Xi_Type
+{
+    id               = Find(id);
+    const auto &node = nodes_[id];
+    switch (node.tag)
+    {
+    case Node::Con:
+        return node.ground;
+    case Node::Arr:
+        return type::array{Resolve(node.children.front())};
+    case Node::Fun:
+    {
+        auto params = std::vector<type::Xi_Type>{};
+        params.reserve(node.children.size() - 1);
+        for (auto it = node.children.begin() + 1; it != node.children.end();
+             it++)
+        {
+            params.push_back(Resolve(*it));
+        }
+        return type::function{
+            .return_type = Resolve(node.children.front()),
+            .param_types = std::move(params),
+            .is_vararg   = node.is_vararg,
+        };
+    }
+    default:
+        // an unbound variable defaults to the first type it allows
+        if (node.allowed == AnyKind || (node.allowed & ~Other) == 0)
+        {
+            return type::unknown{};
+        }
+        auto lowest = static_cast<Kind>(node.allowed & -node.allowed);
+        return nodes_[Builtin(lowest)].ground;
+    }
+}
+
+auto InferState::AsFunction(TypeId id) -> std::optional<TypeId>
+{
+    id = Find(id);
+    if (nodes_[id].tag == Node::Fun)
+    {
+        return id;
+    }
+    return std::nullopt;
+}
+
+auto InferState::Result(TypeId function) const -> TypeId
+{
+    return nodes_[function].children.front();
+}
+
+auto InferState::Params(TypeId function) const -> std::vector<TypeId>
+{
+    return {nodes_[function].children.begin() + 1,
+            nodes_[function].children.end()};
+}
+
+auto InferState::IsVararg(TypeId function) const -> bool
+{
+    return nodes_[function].is_vararg;
+}
+
+auto InferState::Generalize(TypeId id) -> bool
+{
+    id         = Find(id);
+    auto &node = nodes_[id];
+    if (node.tag == Node::Var)
+    {
+        if (node.level != generic_level && node.level > level_ &&
+            node.allowed == AnyKind)
+        {
+            node.level = generic_level;
+        }
+        return node.level == generic_level;
+    }
+    auto generic = false;
+    for (auto child : node.children)
+    {
+        generic = Generalize(child) || generic;
+    }
+    return generic;
+}
+
+auto InferState::instantiate(
+    TypeId id, std::vector<std::pair<TypeId, TypeId>> &fresh
+) -> TypeId
+{
+    id = Find(id);
+    switch (nodes_[id].tag)
+    {
+    case Node::Var:
+    {
+        if (nodes_[id].level != generic_level)
+        {
+            return id;
+        }
+        auto it =
+            std::ranges::find(fresh, id, &std::pair<TypeId, TypeId>::first);
+        if (it != fresh.end())
+        {
+            return it->second;
+        }
+        return fresh.emplace_back(id, Fresh()).second;
+    }
+    case Node::Con:
+        return id;
+    default:
+    {
+        // children are copied, instantiating may grow nodes_
+        auto children = nodes_[id].children;
+        auto changed  = false;
+        for (auto &child : children)
+        {
+            auto copy = instantiate(child, fresh);
+            changed   = changed || copy != Find(child);
+            child     = copy;
+        }
+        if (!changed)
+        {
+            return id;
+        }
+        auto copy = push(Node{
+            .tag       = nodes_[id].tag,
+            .is_vararg = nodes_[id].is_vararg,
+            .children  = std::move(children),
+        });
+        return copy;
+    }
+    }
+}
+
+auto InferState::Instantiate(TypeId id) -> TypeId
+{
+    auto fresh = std::vector<std::pair<TypeId, TypeId>>{};
+    return instantiate(id, fresh);
+}
+
+void InferState::Annotate(type::Xi_Type &slot, TypeId id)
+{
+    slots_.emplace_back(&slot, id);
+}
+
+void InferState::WriteBack()
+{
+    for (auto &[slot, id] : slots_)
+    {
+        *slot = Resolve(id);
+    }
+    slots_.clear();
+}
+
+auto annotated(type::Xi_Type &slot, InferState &st)
+{
+    return [&slot, &st](TypeId id) -> ExpectedTypeAssign<TypeId>
+    {
+        st.Annotate(slot, id);
+        return id;
+    };
+}
+
+auto lookupVar(Symbol name, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    if (const auto *binding = scope.find(name); binding != nullptr)
+    {
+        return binding->generic ? st.Instantiate(binding->id) : binding->id;
+    }
+    if (const auto *declared = st.Record().find(name); declared != nullptr)
+    {
+        return st.FromType(*declared);
+    }
+    return tl::make_unexpected(TypeAssignError{
+        TypeAssignError::UnknownVariable,
+        fmt::format("undeclared variable {}", name),
+    });
+}
+
+auto Infer(std::monostate /*unused*/, const InferScope &, InferState &)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return tl::make_unexpected(TypeAssignError{
+        TypeAssignError::TypeMismatch, "not implemented"});
+}
+
+auto Infer(const Xi_Integer & /*unused*/, const InferScope &, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return st.Builtin(InferState::I64);
+}
+
+auto Infer(const Xi_Real & /*unused*/, const InferScope &, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return st.Builtin(InferState::Real);
+}
+
+auto Infer(const Xi_String & /*unused*/, const InferScope &, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return st.Builtin(InferState::String);
+}
+
+auto Infer(const Xi_Boolean & /*unused*/, const InferScope &, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return st.Builtin(InferState::Buer);
+}
+
+auto Infer(Xi_Iden &iden, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return lookupVar(iden.name, scope, st) >>= annotated(iden.type, st);
+}
+
+auto inferDot(Xi_Binop &binop, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return Infer(binop.lhs, scope, st) >>=
+           [&binop, &st](TypeId lhs) -> ExpectedTypeAssign<TypeId>
+    {
+        auto lhs_type = st.Resolve(lhs);
+        if (!type::isSet(lhs_type))
+        {
+            return tl::make_unexpected(TypeAssignError{
+                TypeAssignError::TypeMismatch,
+                fmt::format(
+                    "Dot operator can only be applied to set, but got {}",
+                    lhs_type
+                ),
+            });
+        }
+        if (!std::holds_alternative<recursive_wrapper<Xi_Iden>>(binop.rhs))
+        {
+            return tl::make_unexpected(TypeAssignError{
+                TypeAssignError::TypeMismatch,
+                fmt::format(
+                    "rhs of dot operator must be an identifier, but got {}",
+                    binop.rhs
+                ),
+            });
+        }
+        const auto &set_type =
+            std::get<recursive_wrapper<type::set>>(lhs_type).get();
+        const auto &member_name =
+            std::get<recursive_wrapper<Xi_Iden>>(binop.rhs).get().name;
+        const auto &member_text = member_name.str();
+        auto        member      = std::ranges::find_if(
+            set_type.members,
+            [&member_text](const auto &m)
+            {
+                return m.first == member_text;
+            }
+        );
+        if (member == set_type.members.end())
+        {
+            return tl::make_unexpected(TypeAssignError{
+                TypeAssignError::TypeMismatch,
+                fmt::format(
+                    "set {} has no member named {}", set_type.name, member_name
+                ),
+            });
+        }
+        binop.index = std::distance(set_type.members.begin(), member);
+        return annotated(binop.type, st)(st.FromType(member->second));
+    };
+}
+
+// result of a binary operator whose operands were unified to operand
+auto inferBinopResult(Xi_Op op, TypeId operand, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    auto buer = [&st](TypeId) -> ExpectedTypeAssign<TypeId>
+    {
+        return st.Builtin(InferState::Buer);
+    };
+    switch (op)
+    {
+    case Xi_Op::Mod:
+        return st.Unify(st.Builtin(InferState::I64), operand);
+    case Xi_Op::Add:
+    case Xi_Op::Sub:
+    case Xi_Op::Mul:
+    case Xi_Op::Div:
+        return st.Constrain(operand, InferState::I64 | InferState::Real);
+    case Xi_Op::Eq:
+    case Xi_Op::Neq:
+        return st.Constrain(
+                   operand,
+                   InferState::I64 | InferState::Real | InferState::Buer
+               ) >>= buer;
+    case Xi_Op::Lt:
+    case Xi_Op::Gt:
+    case Xi_Op::Geq:
+    case Xi_Op::Leq:
+        return st.Constrain(operand, InferState::I64 | InferState::Real) >>=
+               buer;
+    case Xi_Op::Or:
+    case Xi_Op::And:
+        return st.Unify(st.Builtin(InferState::Buer), operand);
+    case Xi_Op::Xor:
+        return st.Constrain(operand, InferState::Buer | InferState::I64);
+    default:
+        return operand;
+    }
+}
+
+auto Infer(Xi_Binop &binop, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    if (binop.op == Xi_Op::Dot)
+    {
+        return inferDot(binop, scope, st);
+    }
+    return Infer(binop.lhs, scope, st) >>= [&binop, &scope, &st](TypeId lhs)
+    {
+        return Infer(binop.rhs, scope, st) >>= [&binop, &st, lhs](TypeId rhs)
+        {
+            return st.Unify(lhs, rhs) >>= [&binop, &st](TypeId operand)
+            {
+                return inferBinopResult(binop.op, operand, st) >>=
+                       annotated(binop.type, st);
+            };
+        };
+    };
+}
+
+auto Infer(Xi_Unop &unop, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return Infer(unop.expr, scope, st) >>=
+           [&unop, &st](TypeId operand) -> ExpectedTypeAssign<TypeId>
+    {
+        switch (unop.op)
+        {
+        case Xi_Op::Sub:
+        case Xi_Op::Add:
+            return st.Constrain(operand, InferState::I64 | InferState::Real) >>=
+                   annotated(unop.type, st);
+        case Xi_Op::Not:
+            return st.Unify(st.Builtin(InferState::Buer), operand) >>=
+                   annotated(unop.type, st);
+        default:
+            return tl::make_unexpected(TypeAssignError{
+                TypeAssignError::TypeMismatch,
+                "",
+            });
+        }
+    };
+}
+
+auto Infer(Xi_If &if_expr, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return Infer(if_expr.cond, scope, st) >>=
+           [&if_expr, &scope, &st](TypeId cond)
+    {
+        return st.Unify(st.Builtin(InferState::Buer), cond) >>=
+               [&if_expr, &scope, &st](TypeId)
+        {
+            return Infer(if_expr.then, scope, st) >>=
+                   [&if_expr, &scope, &st](TypeId then)
+            {
+                return Infer(if_expr.els, scope, st) >>=
+                       [&if_expr, &st, then](TypeId els)
+                {
+                    return st.Unify(then, els) >>= annotated(if_expr.type, st);
+                };
+            };
+        };
+    };
+}
+
+auto Infer(Xi_Lam &lam, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    // lambda parameters are monomorphic inside the body
+    auto body_scope = scope.Extend();
+    auto params     = std::vector<TypeId>{};
+    params.reserve(lam.args.size());
+    for (auto &arg : lam.args)
+    {
+        auto param = st.Fresh();
+        params.push_back(param);
+        body_scope.insert_or_assign(arg.name, InferBinding{.id = param});
+        st.Annotate(arg.type, param);
+    }
+    return Infer(lam.body, body_scope, st) >>= [&lam, &st, &params](TypeId body)
+    {
+        return annotated(lam.type, st)(st.Function(body, params));
+    };
+}
+
+auto calleeType(Symbol name, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    if (const auto *binding = scope.find(name); binding != nullptr)
+    {
+        return binding->generic ? st.Instantiate(binding->id) : binding->id;
+    }
+    if (IsLenBuiltin(name))
+    {
+        return st.Function(st.FromType(type::i64{}), {st.Array(st.Fresh())});
+    }
+    return findInSymbolTable(name, SymbolType::Function) >>=
+           [&st](const type::Xi_Type &declared) -> ExpectedTypeAssign<TypeId>
+    {
+        return st.FromType(declared);
+    };
+}
+
+auto Infer(Xi_Call &call_expr, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return calleeType(call_expr.name, scope, st) >>=
+           [&call_expr, &scope, &st](TypeId callee)
+    {
+        return traverse(
+                   call_expr.args,
+                   [&scope, &st](Xi_Expr &arg)
+                   {
+                       return Infer(arg, scope, st);
+                   }
+               ) >>= [&call_expr, &st, callee](std::vector<TypeId> args
+                     ) -> ExpectedTypeAssign<TypeId>
+        {
+            auto function = st.AsFunction(callee);
+            if (function.has_value() && st.IsVararg(*function))
+            {
+                // only the parameters before the vararg are typed
+                auto params = st.Params(*function);
+                if (args.size() < params.size())
+                {
+                    return tl::make_unexpected(TypeAssignError{
+                        TypeAssignError::ParameterCountMismatch,
+                        fmt::format(
+                            "expect at least {} params, find {}",
+                            params.size(),
+                            args.size()
+                        ),
+                    });
+                }
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    if (auto unified = st.Unify(params[i], args[i]); !unified)
+                    {
+                        return unified;
+                    }
+                }
+                return annotated(call_expr.type, st)(st.Result(*function));
+            }
+            auto ret = st.Fresh();
+            return st.Unify(callee, st.Function(ret, args)) >>=
+                   [&call_expr, &st, ret](TypeId)
+            {
+                return annotated(call_expr.type, st)(ret);
+            };
+        };
+    };
+}
+
+auto Infer(Xi_Array &arr, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    auto element = st.Fresh();
+    return traverse(
+               arr.elements,
+               [&scope, &st, element](Xi_Expr &expr)
+               {
+                   return Infer(expr, scope, st) >>= [&st, element](TypeId t)
+                   {
+                       return st.Unify(element, t);
+                   };
+               }
+           ) >>= [&arr, &st, element](const std::vector<TypeId> &)
+    {
+        return annotated(arr.type, st)(st.Array(element));
+    };
+}
+
+auto Infer(Xi_ArrayIndex &index, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return lookupVar(index.array_var_name, scope, st) >>=
+           [&index, &scope, &st](TypeId array)
+    {
+        auto element = st.Fresh();
+        return st.Unify(st.Array(element), array) >>=
+               [&index, &scope, &st, element](TypeId)
+        {
+            return Infer(index.index, scope, st) >>=
+                   [&index, &st, element](TypeId i)
+            {
+                return st.Unify(st.Builtin(InferState::I64), i) >>=
+                       [&index, &st, element](TypeId)
+                {
+                    return annotated(index.type, st)(element);
+                };
+            };
+        };
+    };
+}
+
+auto Infer(Xi_Assign &assign, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return lookupVar(assign.name, scope, st) >>=
+           [&assign, &scope, &st](TypeId var)
+    {
+        return Infer(assign.expr, scope, st) >>= [&assign, &st, var](TypeId e)
+        {
+            return st.Unify(var, e) >>= annotated(assign.type, st);
+        };
+    };
+}
+
+auto Infer(Xi_Expr &expr, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>
+{
+    return Visit(
+        [&scope, &st](auto &node)
+        {
+            return Infer(node, scope, st);
+        },
+        expr
+    );
+}
+
+auto InferLam(Xi_Lam &lam, LocalVariableRecord record) -> TypeAssignResult
+{
+    auto st = InferState{std::move(record)};
+    return Infer(lam, InferScope{}, st) >>=
+           [&lam, &st](TypeId) -> TypeAssignResult
+    {
+        st.WriteBack();
+        return lam.type;
+    };
+}
+
+auto InferLet(
+    std::vector<Xi_Iden> &let_idens,
+    Xi_Expr              &body,
+    const type::Xi_Type  &expected,
+    LocalVariableRecord   record
+) -> TypeAssignResult
+{
+    auto st = InferState{std::move(record)};
+    return traverse(
+               let_idens,
+               [&st](Xi_Iden &let_var) -> ExpectedTypeAssign<InferBinding>
+               {
+                   st.EnterLevel();
+                   auto bound = Infer(let_var.expr, InferScope{}, st);
+                   st.LeaveLevel();
+                   return bound >>= [&let_var, &st](TypeId id)
+                   {
+                       st.Annotate(let_var.type, id);
+                       return ExpectedTypeAssign<InferBinding>{InferBinding{
+                           .id = id, .generic = st.Generalize(id)}};
+                   };
+               }
+           ) >>= [&let_idens, &body, &expected, &st](
+                     const std::vector<InferBinding> &bindings
+                 ) -> TypeAssignResult
+    {
+        auto scope = InferScope{};
+        for (auto &&[let_var, binding] :
+             ranges::views::zip(let_idens, bindings))
+        {
+            scope.insert_or_assign(let_var.name, binding);
+        }
+        return Infer(body, scope, st) >>= [&expected, &st](TypeId body_type)
+        {
+            return st.Unify(st.FromType(expected), body_type) >>=
+                   [&st](TypeId unified) -> TypeAssignResult
+            {
+                st.WriteBack();
+                return st.Resolve(unified);
+            };
+        };
+    };
+}
+
+} // namespace xi
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "compiler/ast/error.h"
+#include "compiler/ast/expr/expr.h"
+#include "compiler/ast/type.h"
+#include "compiler/utils/scoped_table.h"
+#include "compiler/utils/symbol.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace xi
+{
+
+struct Xi_Iden;
+struct Xi_Lam;
+
+// index of a type term inside an InferState
+using TypeId = uint32_t;
+
+// Hindley-Milner style inference over union-find type terms.
+//
+// Every type term is a node in one flat array. Unifying a variable links its
+// node to the other term and Find compresses paths as it walks, so there is no
+// substitution to build or apply. Let-bound helpers are generalized by level:
+// variables created while inferring the binding that were not unified with
+// anything outside it become generic and are copied fresh at each use.
+//
+// Operators that accept several ground types (+ on i64 and real, == on
+// buer too) put a kind constraint on the variable instead. Constrained
+// variables are never generalized, and one left unbound at the end resolves to
+// the first type it allows.
+class InferState
+{
+  public:
+    // ground kinds a type variable may still be bound to
+    enum Kind : uint8_t
+    {
+        I64     = 1U << 0U,
+        Real    = 1U << 1U,
+        Buer    = 1U << 2U,
+        String  = 1U << 3U,
+        Other   = 1U << 4U,
+        AnyKind = I64 | Real | Buer | String | Other,
+    };
+
+    explicit InferState(LocalVariableRecord record = {});
+
+    auto Fresh(uint8_t allowed = AnyKind) -> TypeId;
+    auto Function(TypeId ret, const std::vector<TypeId> &params) -> TypeId;
+    auto Array(TypeId element) -> TypeId;
+    auto FromType(const type::Xi_Type &xi_type) -> TypeId;
+    [[nodiscard]] auto Builtin(Kind kind) const -> TypeId;
+
+    auto Find(TypeId id) -> TypeId;
+    auto Unify(TypeId lhs, TypeId rhs) -> ExpectedTypeAssign<TypeId>;
+    // restrict id to the ground kinds in allowed
+    auto Constrain(TypeId id, uint8_t allowed) -> ExpectedTypeAssign<TypeId>;
+    auto Resolve(TypeId id) -> type::Xi_Type;
+
+    // the function term id is bound to, if any
+    auto AsFunction(TypeId id) -> std::optional<TypeId>;
+    [[nodiscard]] auto Result(TypeId function) const -> TypeId;
+    [[nodiscard]] auto Params(TypeId function) const -> std::vector<TypeId>;
+    [[nodiscard]] auto IsVararg(TypeId function) const -> bool;
+
+    void EnterLevel() { level_++; }
+    void LeaveLevel() { level_--; }
+    // mark variables deeper than the current level generic, returns whether
+    // any were found
+    auto Generalize(TypeId id) -> bool;
+    auto Instantiate(TypeId id) -> TypeId;
+
+    // variables outside the inferred expression, with their declared types
+    [[nodiscard]] auto Record() const -> const LocalVariableRecord &
+    {
+        return record_;
+    }
+
+    // remember slot to receive the final type of id
+    void Annotate(type::Xi_Type &slot, TypeId id);
+    void WriteBack();
+
+  private:
+    static constexpr uint32_t generic_level =
+        std::numeric_limits<uint32_t>::max();
+
+    struct Node
+    {
+        enum Tag : uint8_t
+        {
+            Var,
+            Con,
+            Fun,
+            Arr,
+        };
+
+        Tag           tag;
+        uint8_t       allowed   = AnyKind;
+        bool          is_vararg = false;
+        uint32_t      parent    = 0;
+        uint32_t      rank      = 0;
+        uint32_t      level     = 0;
+        // the ground type of a Con node
+        type::Xi_Type ground = type::unknown{};
+        // Fun: return type then params, Arr: element type
+        std::vector<TypeId> children = {};
+    };
+
+    auto push(Node node) -> TypeId;
+    auto link(TypeId from, TypeId to) -> TypeId;
+    auto bindVar(TypeId var, TypeId term) -> ExpectedTypeAssign<TypeId>;
+    auto occursAdjust(TypeId var, TypeId term, uint32_t level) -> bool;
+    auto instantiate(TypeId id, std::vector<std::pair<TypeId, TypeId>> &fresh)
+        -> TypeId;
+    auto mismatch(TypeId lhs, TypeId rhs) -> TypeAssignError;
+
+    std::vector<Node>                               nodes_;
+    std::vector<std::pair<type::Xi_Type *, TypeId>> slots_;
+    LocalVariableRecord                             record_;
+    std::array<TypeId, 4>                           builtins_{};
+    uint32_t                                        level_ = 1;
+};
+
+// a name bound during inference, generic if its type must be instantiated
+struct InferBinding
+{
+    TypeId id;
+    bool   generic = false;
+};
+
+using InferScope = ScopedTable<Symbol, InferBinding>;
+
+auto Infer(Xi_Expr &expr, const InferScope &scope, InferState &st)
+    -> ExpectedTypeAssign<TypeId>;
+
+// infer a lambda whose free variables are declared in record
+auto InferLam(Xi_Lam &lam, LocalVariableRecord record) -> TypeAssignResult;
+
+// infer `let let_idens in body` where body must have type expected; each
+// binding sees only record, the body sees record and every binding
+auto InferLet(
+    std::vector<Xi_Iden> &let_idens,
+    Xi_Expr              &body,
+    const type::Xi_Type  &expected,
+    LocalVariableRecord   record
+) -> TypeAssignResult;
+
+} // namespace xi
@@ -0,0 +1,111 @@
+#include "compiler/ast/ownership.h"
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/visit.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace xi
+{
+
+// count every use of a name in expr, and keep the identifiers evaluated
+// whenever expr is
+void countUses(
+    const Xi_Expr                      &expr,
+    bool                                conditional,
+    std::unordered_map<Symbol, size_t> &uses,
+    std::vector<const Xi_Iden *>       &always
+)
+{
+    auto count = [&uses, &always](const Xi_Expr &child, bool conditional_)
+    {
+        countUses(child, conditional_, uses, always);
+    };
+    Visit(
+        [conditional, &uses, &always, &count]<typename T>(const T &node)
+        {
+            if constexpr (std::same_as<T, Xi_Iden>)
+            {
+                uses[node.name]++;
+                if (!conditional)
+                {
+                    always.push_back(&node);
+                }
+            }
+            else if constexpr (std::same_as<T, Xi_ArrayIndex>)
+            {
+                uses[node.array_var_name]++;
+                count(node.index, conditional);
+            }
+            else if constexpr (std::same_as<T, Xi_Assign>)
+            {
+                uses[node.name]++;
+                count(node.expr, conditional);
+            }
+            else if constexpr (std::same_as<T, Xi_Call>)
+            {
+                for (const auto &arg : node.args)
+                {
+                    count(arg, conditional);
+                }
+            }
+            else if constexpr (std::same_as<T, Xi_If>)
+            {
+                count(node.cond, conditional);
+                count(node.then, true);
+                count(node.els, true);
+            }
+            else if constexpr (std::same_as<T, Xi_Binop>)
+            {
+                count(node.lhs, conditional);
+                // the right of a dot names a member, not a value, and the
+                // right of && or || runs only when the left does not decide
+                if (node.op != Xi_Op::Dot)
+                {
+                    count(
+                        node.rhs,
+                        conditional || node.op == Xi_Op::And ||
+                            node.op == Xi_Op::Or
+                    );
+                }
+            }
+            else if constexpr (std::same_as<T, Xi_Unop>)
+            {
+                count(node.expr, conditional);
+            }
+            else if constexpr (std::same_as<T, Xi_Array>)
+            {
+                for (const auto &element : node.elements)
+                {
+                    count(element, conditional);
+                }
+            }
+            else if constexpr (std::same_as<T, Xi_Lam>)
+            {
+                count(node.body, true);
+            }
+        },
+        expr
+    );
+}
+
+auto LastUses(const Xi_Expr &expr) -> std::unordered_set<const Xi_Iden *>
+{
+    auto uses   = std::unordered_map<Symbol, size_t>{};
+    auto always = std::vector<const Xi_Iden *>{};
+    countUses(expr, false, uses, always);
+    auto last = std::unordered_set<const Xi_Iden *>{};
+    std::ranges::copy_if(
+        always,
+        std::inserter(last, last.end()),
+        [&uses](const Xi_Iden *iden)
+        {
+            return uses[iden->name] == 1;
+        }
+    );
+    return last;
+}
+
+} // namespace xi
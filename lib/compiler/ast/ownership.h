@@ -0,0 +1,17 @@
+#pragma once
+
+#include "compiler/ast/expr/expr.h"
+
+#include <unordered_set>
+
+namespace xi
+{
+
+// The names in expr, the last thing a function evaluates, that are used only
+// once and on every path through it: nothing reads them after that use, so it
+// can take over the function's reference instead of counting a new one. Names
+// under an if inside expr, or right of a && or ||, are left out, since they
+// may not run.
+auto LastUses(const Xi_Expr &expr) -> std::unordered_set<const Xi_Iden *>;
+
+} // namespace xi
@@ -0,0 +1,203 @@
+#include "compiler/ast/purity.h"
+
+#include "compiler/ast/all.h"
+#include "compiler/ast/visit.h"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+namespace xi
+{
+
+// whether values of type hold an array, or a function of type takes or
+// returns one
+auto holdsArray(const type::Xi_Type &type) -> bool
+{
+    if (std::holds_alternative<recursive_wrapper<type::array>>(type))
+    {
+        return true;
+    }
+    if (const auto *set = std::get_if<recursive_wrapper<type::set>>(&type))
+    {
+        return std::ranges::any_of(
+            set->get().members,
+            [](const auto &member)
+            {
+                return holdsArray(member.second);
+            }
+        );
+    }
+    if (const auto *func =
+            std::get_if<recursive_wrapper<type::function>>(&type))
+    {
+        return holdsArray(func->get().return_type) ||
+               std::ranges::any_of(func->get().param_types, holdsArray);
+    }
+    return false;
+}
+
+// add the names expr calls; whether expr does nothing else than compute
+auto collectCalls(const Xi_Expr &expr, std::vector<Symbol> &callees) -> bool
+{
+    auto collect = [&callees](const Xi_Expr &child)
+    {
+        return collectCalls(child, callees);
+    };
+    return Visit(
+        [&callees, &collect]<typename T>(const T &node) -> bool
+        {
+            if constexpr (std::same_as<T, Xi_Call>)
+            {
+                callees.push_back(node.name);
+                return std::ranges::all_of(node.args, collect);
+            }
+            else if constexpr (std::same_as<T, Xi_If>)
+            {
+                return collect(node.cond) && collect(node.then) &&
+                       collect(node.els);
+            }
+            else if constexpr (std::same_as<T, Xi_Binop>)
+            {
+                return collect(node.lhs) && collect(node.rhs);
+            }
+            else if constexpr (std::same_as<T, Xi_Unop>)
+            {
+                return collect(node.expr);
+            }
+            else if constexpr (std::same_as<T, Xi_Array> ||
+                               std::same_as<T, Xi_ArrayIndex> ||
+                               std::same_as<T, Xi_Lam> ||
+                               std::same_as<T, Xi_Assign>)
+            {
+                return false;
+            }
+            return true;
+        },
+        expr
+    );
+}
+
+// the functions func calls, if func itself only computes; a call of one of its
+// own names goes to a value that may do anything
+auto pureCalls(const Xi_Func &func, const type::Xi_Type &signature)
+    -> std::optional<std::vector<Symbol>>
+{
+    auto calls = std::vector<Symbol>{};
+    auto local = !holdsArray(signature) && collectCalls(func.expr, calls) &&
+                 std::ranges::all_of(
+                     func.let_idens,
+                     [&calls](const Xi_Iden &let)
+                     {
+                         return collectCalls(let.expr, calls);
+                     }
+                 );
+    auto is_own_name = [&func](Symbol name)
+    {
+        return std::ranges::find(func.params, name) != func.params.end() ||
+               std::ranges::any_of(
+                   func.let_idens,
+                   [name](const Xi_Iden &let)
+                   {
+                       return let.name == name;
+                   }
+               );
+    };
+    if (!local || std::ranges::any_of(calls, is_own_name))
+    {
+        return std::nullopt;
+    }
+    return calls;
+}
+
+auto FunctionEffects(const Xi_Program &program) -> SymbolMap<Effects>
+{
+    auto signatures = SymbolMap<const type::Xi_Type *>{};
+    auto functions  = std::vector<const Xi_Func *>{};
+    auto effects    = SymbolMap<Effects>{};
+    for (const auto &stmt : program.stmts)
+    {
+        if (const auto *decl = std::get_if<Xi_Decl>(&stmt))
+        {
+            signatures.insert_or_assign(decl->name, &decl->type);
+        }
+        const auto *func = std::get_if<recursive_wrapper<Xi_Func>>(&stmt);
+        if (func != nullptr)
+        {
+            effects.insert_or_assign(func->get().name, Effects{});
+            if (func->get().expr != std::monostate{})
+            {
+                functions.push_back(&func->get());
+            }
+        }
+        // a constructor only stores its arguments into the set it returns
+        if (const auto *set = std::get_if<Xi_Set>(&stmt))
+        {
+            effects.insert_or_assign(
+                set->name, Effects{.pure = true, .returns = true}
+            );
+        }
+    }
+
+    auto callees = SymbolMap<std::vector<Symbol>>{};
+    for (const auto *func : functions)
+    {
+        const auto *signature = signatures.find(func->name);
+        if (signature == nullptr)
+        {
+            continue;
+        }
+        if (auto calls = pureCalls(*func, **signature))
+        {
+            callees.insert_or_assign(func->name, std::move(*calls));
+            effects.insert_or_assign(func->name, Effects{.pure = true});
+        }
+    }
+    auto callee_is = [&effects](bool Effects::*property)
+    {
+        return [&effects, property](Symbol callee)
+        {
+            const auto *effect = effects.find(callee);
+            return effect != nullptr && effect->*property;
+        };
+    };
+
+    // every candidate is pure until it calls one that is not, so functions
+    // calling each other stay pure
+    for (auto changed = true; changed;)
+    {
+        changed = false;
+        for (const auto *func : functions)
+        {
+            auto       *effect = effects.find(func->name);
+            const auto *calls  = callees.find(func->name);
+            if (effect != nullptr && effect->pure &&
+                !std::ranges::all_of(*calls, callee_is(&Effects::pure)))
+            {
+                effect->pure = false;
+                changed      = true;
+            }
+        }
+    }
+
+    // none returns until everything it calls does, so no call that may come
+    // back to it is ever known to
+    for (auto changed = true; changed;)
+    {
+        changed = false;
+        for (const auto *func : functions)
+        {
+            auto       *effect = effects.find(func->name);
+            const auto *calls  = callees.find(func->name);
+            if (effect != nullptr && effect->pure && !effect->returns &&
+                std::ranges::all_of(*calls, callee_is(&Effects::returns)))
+            {
+                effect->returns = true;
+                changed         = true;
+            }
+        }
+    }
+    return effects;
+}
+
+} // namespace xi
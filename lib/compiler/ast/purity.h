@@ -0,0 +1,28 @@
+#pragma once
+
+#include "compiler/utils/symbol.h"
+
+namespace xi
+{
+
+struct Xi_Program;
+
+// What calling a function of a program may do besides computing its result.
+struct Effects
+{
+    // reads and writes no memory but its own frame and the result it builds
+    bool pure    = false;
+    // comes back on every argument, calling no function that may not
+    bool returns = false;
+};
+
+// The effects of the functions and set constructors program defines.
+//
+// A function is pure unless it assigns, builds a lambda, calls a function
+// known only by a declaration (printf), calls one that is not pure, or takes,
+// makes or returns an array, whose memory and counted references the caller
+// can see. Only a pure function that calls no function that may recurse,
+// itself included, is known to return. Statement functions are neither.
+auto FunctionEffects(const Xi_Program &program) -> SymbolMap<Effects>;
+
+} // namespace xi
@@ -8,7 +8,7 @@ namespace xi
 
 auto TypeAssign(Xi_Decl &decl, LocalVariableRecord) -> TypeAssignResult
 {
-    if (GetSymbolTable().contains({decl.name, SymbolType::Function}))
+    if (GetSymbolTable()[SymbolType::Function].contains(decl.name))
     {
         return tl::make_unexpected(TypeAssignError{
             TypeAssignError::DuplicateDeclaration,
@@ -19,9 +19,9 @@ auto TypeAssign(Xi_Decl &decl, LocalVariableRecord) -> TypeAssignResult
     return findTypeInSymbolTable(decl.return_type, SymbolType::Type) >>=
            [&decl](auto return_type)
     {
-        return flatmap(
+        return traverse(
                    decl.params_type,
-                   [decl](auto x)
+                   [](const std::string &x)
                    {
                        return findTypeInSymbolTable(x, SymbolType::Type);
                    }
@@ -48,8 +48,8 @@ auto TypeAssign(Xi_Decl &decl, LocalVariableRecord) -> TypeAssignResult
                 func_type.is_vararg = true;
             }
 
-            GetSymbolTable().insert(
-                {{decl.name, SymbolType::Function}, func_type}
+            GetSymbolTable()[SymbolType::Function].insert(
+                decl.name, func_type
             );
             return decl.type = func_type;
         };
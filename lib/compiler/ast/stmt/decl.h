@@ -11,7 +11,7 @@ namespace xi
 
 struct Xi_Decl
 {
-    std::string              name;
+    Symbol                   name;
     std::string              return_type;
     std::vector<std::string> params_type;
     bool                     is_vararg = false;
@@ -3,6 +3,7 @@
 
 #include "compiler/ast/all.h"
 #include "compiler/ast/error.h"
+#include "compiler/ast/infer.h"
 
 namespace xi
 {
@@ -14,61 +15,35 @@ auto hasDuplicate(std::vector<T> v)
     return std::adjacent_find(v.begin(), v.end()) != v.end();
 }
 
+// let bindings and the body are inferred together, a let-bound lambda is
+// generalized and instantiated at each call in the body
 auto typeAssignExprFunc(
     Xi_Func &func_def, LocalVariableRecord record, type::function decl_type
 ) -> TypeAssignResult
 {
-    return flatmap_(
-               func_def.let_idens,
-               [record](auto &x)
-               {
-                   return TypeAssign(x.expr, record);
-               }
-           ) >>=
-           [&func_def, record, decl_type](
-               std::vector<type::Xi_Type> let_expr_types
-           ) mutable -> TypeAssignResult
+    if (hasDuplicate(func_def.let_idens))
+    {
+        return tl::make_unexpected(TypeAssignError{
+            TypeAssignError::DuplicateDeclaration,
+            fmt::format("Decl function parameter {}", func_def.name),
+        });
+    }
+    for (const auto &let_var : func_def.let_idens)
     {
-        if (hasDuplicate(func_def.let_idens))
+        if (record.contains(let_var.name))
         {
             return tl::make_unexpected(TypeAssignError{
                 TypeAssignError::DuplicateDeclaration,
-                fmt::format("Decl function parameter {}", func_def.name),
+                fmt::format("{} function let variable", let_var.name),
             });
         }
-        for (auto &&[let_var, let_expr_type] :
-             ranges::views::zip(func_def.let_idens, let_expr_types))
-        {
-            if (record.contains(let_var.name))
-            {
-                return tl::make_unexpected(TypeAssignError{
-                    TypeAssignError::DuplicateDeclaration,
-                    fmt::format("{} function let variable", let_var.name),
-                });
-            }
-
-            let_var.type = let_expr_type;
-            record.insert_or_assign(let_var.name, let_expr_type);
-        }
+    }
 
-        return TypeAssign(func_def.expr, record) >>=
-               [decl_type,
-                &func_def](auto func_def_expr_type) -> TypeAssignResult
-        {
-            if (func_def_expr_type != decl_type.return_type)
-            {
-                return tl::make_unexpected(TypeAssignError{
-                    TypeAssignError::TypeMismatch,
-                    fmt::format(
-                        "expect return {}, find {}",
-                        decl_type.return_type,
-                        func_def_expr_type
-                    ),
-                });
-            }
-            GetFunctionDefinitionTable().insert({func_def.name, decl_type});
-            return func_def.type = decl_type;
-        };
+    return InferLet(
+               func_def.let_idens, func_def.expr, decl_type.return_type, record
+           ) >>= [&func_def, &decl_type](auto) -> TypeAssignResult
+    {
+        return func_def.type = decl_type;
     };
 }
 
@@ -77,34 +52,23 @@ auto typeAssignDeclFunc(
 ) -> TypeAssignResult
 {
     GetCurrentFuncType() = decl_type;
-    return flatmap_(
+    return traverse(
                func_def.stmts,
                [&record](auto &x)
                {
                    return TypeAssign(x, record);
                }
-           ) >>=
-           [&func_def,
-            record,
-            decl_type](std::vector<type::Xi_Type>) mutable -> TypeAssignResult
+           ) >>= [&func_def, &decl_type](std::vector<type::Xi_Type>
+                 ) -> TypeAssignResult
     {
-        GetFunctionDefinitionTable().insert({func_def.name, decl_type});
         return func_def.type = decl_type;
     };
 }
 
-auto TypeAssign(Xi_Func &func_def, LocalVariableRecord record)
+auto TypeAssignFuncBody(Xi_Func &func_def, LocalVariableRecord record)
     -> TypeAssignResult
 {
-    if (GetFunctionDefinitionTable().contains(func_def.name))
-    {
-        return tl::make_unexpected(TypeAssignError{
-            TypeAssignError::DuplicateDefinition,
-            fmt::format("Func {}", func_def.name),
-        });
-    }
-
-    return findTypeInSymbolTable(func_def.name, SymbolType::Function) >>=
+    return findInSymbolTable(func_def.name, SymbolType::Function) >>=
            [&func_def, &record](auto Xi_Type_decl_type)
     {
         return std::visit(
@@ -167,4 +131,23 @@ auto TypeAssign(Xi_Func &func_def, LocalVariableRecord record)
     };
 }
 
+auto TypeAssign(Xi_Func &func_def, LocalVariableRecord record)
+    -> TypeAssignResult
+{
+    if (GetFunctionDefinitionTable().contains(func_def.name))
+    {
+        return tl::make_unexpected(TypeAssignError{
+            TypeAssignError::DuplicateDefinition,
+            fmt::format("Func {}", func_def.name),
+        });
+    }
+
+    return TypeAssignFuncBody(func_def, std::move(record)) >>=
+           [&func_def](type::Xi_Type func_type) -> TypeAssignResult
+    {
+        GetFunctionDefinitionTable().insert(func_def.name, func_type);
+        return func_type;
+    };
+}
+
 } // namespace xi
@@ -13,8 +13,8 @@ namespace xi
 
 struct Xi_Func
 {
-    std::string              name;
-    std::vector<std::string> params;
+    Symbol                   name;
+    std::vector<Symbol>      params;
     Xi_Expr                  expr;
     type::Xi_Type            type      = type::unknown{};
     std::vector<Xi_Iden>     let_idens = {};
@@ -49,4 +49,10 @@ inline auto operator<=>(const Xi_Func &lhs, const Xi_Func &rhs)
 
 auto TypeAssign(Xi_Func &func_def, LocalVariableRecord = {}) -> TypeAssignResult;
 
+// check a function body against its declaration without recording the
+// definition; only reads the global tables, so bodies can be checked
+// concurrently
+auto TypeAssignFuncBody(Xi_Func &func_def, LocalVariableRecord record)
+    -> TypeAssignResult;
+
 } // namespace xi
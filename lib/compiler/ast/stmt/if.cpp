@@ -18,7 +18,7 @@ auto TypeAssign(Xi_If_stmt &if_stmt, LocalVariableRecord record)
                 fmt::format("expect buer, find {}", cond_type),
             });
         }
-        return flatmap_(
+        return traverse(
                    if_stmt.then,
                    [record](auto &x) mutable
                    {
@@ -27,7 +27,7 @@ auto TypeAssign(Xi_If_stmt &if_stmt, LocalVariableRecord record)
                ) >>=
                [cond_type, &if_stmt, record](auto then_type) -> TypeAssignResult
         {
-            return flatmap_(
+            return traverse(
                        if_stmt.els,
                        [record](auto &x) mutable
                        {
@@ -1,24 +1,124 @@
-
 #include "compiler/ast/stmt/program.h"
 
 #include "compiler/ast/all.h"
+#include "compiler/ast/compile_cache.h"
 #include "compiler/ast/type.h"
+#include "compiler/utils/thread_pool.h"
 
 namespace xi
 {
 
-auto TypeAssign(Xi_Program &program)
+// Checking runs in two phases. Declarations, sets and every other statement
+// that fills the global tables are checked first, in program order, along
+// with the rule that a function is declared before it is defined. Function
+// bodies only read those tables, so they are then checked in parallel, and
+// may call functions declared after them. Results keep program order and the
+// first error in program order wins.
+//
+// With a cache, a body whose fingerprint matches its entry is not checked;
+// the annotated body is copied back instead.
+auto typeAssignProgram(Xi_Program &program, FunctionCache *cache)
     -> ExpectedTypeAssign<std::vector<type::Xi_Type>>
 {
     LocalVariableRecord record;
-    return flatmap_(
-        program.stmts,
-        [&record](Xi_Stmt &x)
+    auto results = std::vector<TypeAssignResult>(program.stmts.size());
+    auto bodies  = std::vector<size_t>{};
+    for (size_t i = 0; i < program.stmts.size(); i++)
+    {
+        if (const auto *func =
+                std::get_if<recursive_wrapper<Xi_Func>>(&program.stmts[i]))
+        {
+            auto declared =
+                findInSymbolTable(func->get().name, SymbolType::Function);
+            if (declared.has_value())
+            {
+                bodies.push_back(i);
+            }
+            else
+            {
+                results[i] = std::move(declared);
+            }
+            continue;
+        }
+        results[i] = TypeAssign(program.stmts[i], record);
+    }
+
+    auto funcAt = [&program](size_t i) -> Xi_Func &
+    {
+        return std::get<recursive_wrapper<Xi_Func>>(program.stmts[i]).get();
+    };
+    auto  fingerprints = std::vector<Fingerprint>(bodies.size());
+    auto  reused       = std::vector<char>(bodies.size(), 0);
+    auto &state        = GetTypeAssignState();
+    GetThreadPool().ParallelFor(
+        bodies.size(),
+        [&bodies,
+         &results,
+         &record,
+         &funcAt,
+         &fingerprints,
+         &reused,
+         &state,
+         cache](size_t i)
         {
-            fmt::print("record?? {}\n", record.size());
-            return TypeAssign(x, record);
+            // pool threads check against the caller's tables
+            auto  scope = TypeAssignScope(state);
+            auto &func  = funcAt(bodies[i]);
+            if (cache != nullptr)
+            {
+                fingerprints[i] = FunctionFingerprint(func, record);
+                if (const auto *entry =
+                        cache->Find(func.name, fingerprints[i]))
+                {
+                    func               = entry->func;
+                    results[bodies[i]] = entry->type;
+                    reused[i]          = 1;
+                    return;
+                }
+            }
+            results[bodies[i]] = TypeAssignFuncBody(func, record);
         }
     );
+
+    // definitions are recorded in program order, so a duplicate is reported
+    // at its second definition
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        auto &func   = funcAt(bodies[i]);
+        auto &result = results[bodies[i]];
+        if (result.has_value() &&
+            !GetFunctionDefinitionTable().insert(func.name, *result))
+        {
+            result = tl::make_unexpected(TypeAssignError{
+                TypeAssignError::DuplicateDefinition,
+                fmt::format("Func {}", func.name),
+            });
+        }
+        if (cache != nullptr && result.has_value() && reused[i] == 0)
+        {
+            cache->Store(
+                func.name,
+                FunctionCache::Entry{
+                    .fingerprint = fingerprints[i],
+                    .func        = func,
+                    .type        = *result,
+                }
+            );
+        }
+    }
+    return sequence(std::move(results));
+}
+
+auto TypeAssign(Xi_Program &program)
+    -> ExpectedTypeAssign<std::vector<type::Xi_Type>>
+{
+    return typeAssignProgram(program, nullptr);
+}
+
+auto TypeAssign(Xi_Program &program, FunctionCache &cache)
+    -> ExpectedTypeAssign<std::vector<type::Xi_Type>>
+{
+    return typeAssignProgram(program, &cache);
 }
 
 } // namespace xi
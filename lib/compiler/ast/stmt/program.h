@@ -15,7 +15,14 @@ struct Xi_Program
     auto                 operator<=>(const Xi_Program &rhs) const = default;
 };
 
+class FunctionCache;
+
 auto TypeAssign(Xi_Program &program)
     -> ExpectedTypeAssign<std::vector<type::Xi_Type>>;
 
+// as above, reusing the checked bodies of functions whose fingerprint is
+// unchanged since they were stored in cache
+auto TypeAssign(Xi_Program &program, FunctionCache &cache)
+    -> ExpectedTypeAssign<std::vector<type::Xi_Type>>;
+
 } // namespace xi
@@ -7,16 +7,16 @@ namespace xi
 
 auto TypeAssign(Xi_Set &set, LocalVariableRecord) -> TypeAssignResult
 {
-    if (GetSymbolTable().contains({set.name, SymbolType::Type}))
+    if (GetSymbolTable()[SymbolType::Type].contains(set.name))
     {
         return tl::make_unexpected(TypeAssignError{
             TypeAssignError::DuplicateDeclaration,
             fmt::format("set {}", set.name),
         });
     }
-    return flatmap(
+    return traverse(
                set.members,
-               [set](std::pair<std::string, std::string> name_type)
+               [](const std::pair<std::string, std::string> &name_type)
                {
                    return findTypeInSymbolTable(
                        name_type.second, SymbolType::Type
@@ -36,16 +36,16 @@ auto TypeAssign(Xi_Set &set, LocalVariableRecord) -> TypeAssignResult
                               ranges::to_vector;
         auto set_type = type::set{set.name, name_with_type};
         set.type      = set_type;
-        GetSymbolTable().insert({{set.name, SymbolType::Type}, set_type});
+        GetSymbolTable()[SymbolType::Type].insert(set.name, set_type);
 
         // create constructor
-        GetSymbolTable().insert({
-            {set.name, SymbolType::Function},
+        GetSymbolTable()[SymbolType::Function].insert(
+            set.name,
             type::function{
                 .return_type = set_type,
                 .param_types = member_types,
-            },
-        });
+            }
+        );
         return set.type;
     };
 }
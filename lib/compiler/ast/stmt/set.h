@@ -11,7 +11,7 @@ namespace xi
 
 struct Xi_Set
 {
-    std::string                                      name;
+    Symbol                                           name;
     std::vector<std::pair<std::string, std::string>> members;
     type::Xi_Type                                    type = type::unknown{};
     auto operator<=>(const Xi_Set &) const                = default;
@@ -3,13 +3,14 @@
 #include "compiler/ast/all.h"
 #include "compiler/ast/error.h"
 #include "compiler/ast/type_assign.h"
+#include "compiler/ast/visit.h"
 
 namespace xi
 {
 
 auto TypeAssign(Xi_Stmt &stmt, LocalVariableRecord &record) -> TypeAssignResult
 {
-    return std::visit(
+    return Visit(
         [&record](auto &x) -> TypeAssignResult
         {
             return TypeAssign(x, record);
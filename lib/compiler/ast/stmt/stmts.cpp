@@ -8,7 +8,7 @@ namespace xi
 
 auto TypeAssign(Xi_Stmts &stmt, LocalVariableRecord &record) -> TypeAssignResult
 {
-    auto types = flatmap_(
+    auto types = traverse(
         stmt.stmts,
         [&record](auto &x)
         {
@@ -11,7 +11,7 @@ namespace xi
 
 struct Xi_Var
 {
-    std::string   name;
+    Symbol        name;
     Xi_Expr       value;
     std::string   type_name;
     type::Xi_Type type                              = type::unknown{};
@@ -18,7 +18,7 @@ auto TypeAssign(Xi_While &whilest, LocalVariableRecord record) -> TypeAssignResu
                 TypeAssignError::TypeMismatch,
                 fmt::format("expect buer, find {}", cond_type)});
         }
-        return flatmap_(
+        return traverse(
                    whilest.body,
                    [&record](auto &x)
                    {
@@ -0,0 +1,28 @@
+#include "compiler/ast/tail_call.h"
+
+#include "compiler/ast/all.h"
+
+namespace xi
+{
+
+void collectTailCalls(const Xi_Expr &expr, std::vector<const Xi_Call *> &calls)
+{
+    if (const auto *call = std::get_if<recursive_wrapper<Xi_Call>>(&expr))
+    {
+        calls.push_back(&call->get());
+    }
+    else if (const auto *if_expr = std::get_if<recursive_wrapper<Xi_If>>(&expr))
+    {
+        collectTailCalls(if_expr->get().then, calls);
+        collectTailCalls(if_expr->get().els, calls);
+    }
+}
+
+auto TailCalls(const Xi_Func &func) -> std::vector<const Xi_Call *>
+{
+    auto calls = std::vector<const Xi_Call *>{};
+    collectTailCalls(func.expr, calls);
+    return calls;
+}
+
+} // namespace xi
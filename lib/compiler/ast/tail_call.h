@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+namespace xi
+{
+
+struct Xi_Func;
+struct Xi_Call;
+
+// The calls in tail position in the body of an expression function: the body
+// itself, or a branch of an if in tail position. Nothing is left to do in the
+// caller once such a call returns, so its frame can be dropped before the
+// call, and a call of func itself can jump back to the start of func instead.
+// A function with statements has none.
+auto TailCalls(const Xi_Func &func) -> std::vector<const Xi_Call *>;
+
+} // namespace xi
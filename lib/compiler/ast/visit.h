@@ -0,0 +1,58 @@
+#pragma once
+
+#include "compiler/utils/recursive_wrapper.h"
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace xi
+{
+
+template <typename T>
+struct is_recursive_wrapper : std::false_type
+{
+};
+
+template <typename T>
+struct is_recursive_wrapper<recursive_wrapper<T>> : std::true_type
+{
+};
+
+template <typename T>
+inline constexpr bool is_recursive_wrapper_v =
+    is_recursive_wrapper<std::remove_cvref_t<T>>::value;
+
+// unwrap a recursive_wrapper, keeping the constness of the reference
+template <typename Node>
+inline auto Unwrap(Node &node) -> decltype(auto)
+{
+    if constexpr (is_recursive_wrapper_v<Node>)
+    {
+        return node.get();
+    }
+    else
+    {
+        return (node);
+    }
+}
+
+// Dispatch visitor on the alternative held by an ast variant (Xi_Expr,
+// Xi_Stmt), passing the node by reference with recursive_wrapper already
+// unwrapped. A const variant gives the visitor const nodes, so read-only
+// passes (code generators, formatter) never copy a subtree; a mutable
+// variant gives mutable nodes for annotation passes such as TypeAssign.
+template <typename Visitor, typename Variant>
+inline auto Visit(Visitor &&visitor, Variant &node) -> decltype(auto)
+{
+    return std::visit(
+        [&visitor](auto &alternative) -> decltype(auto)
+        {
+            return std::invoke(visitor, Unwrap(alternative));
+        },
+        node
+    );
+}
+
+} // namespace xi
@@ -5,6 +5,8 @@
 #include <range/v3/action/transform.hpp>
 #include <range/v3/algorithm.hpp>
 #include <range/v3/view.hpp>
+#include <tl/expected.hpp>
+#include <type_traits>
 #include <vector>
 
 namespace xi
@@ -25,6 +27,36 @@ auto Unit(T t) -> M<T, Args...>
     return unit_<M<T, Args...>>::unit(t);
 }
 
+// map func over a range and collect the results into one monad
+//
+// Results are moved into a vector reserved up front, and the walk stops at
+// the first error, so no element after it is evaluated.
+template <typename Range, typename Func>
+auto traverse(Range &&range, Func &&func)
+{
+    using result_t = std::remove_cvref_t<
+        std::invoke_result_t<Func &, ranges::range_reference_t<Range>>>;
+    using value_t  = typename result_t::value_type;
+    using error_t  = typename result_t::error_type;
+    using expect_t = tl::expected<std::vector<value_t>, error_t>;
+
+    auto values = std::vector<value_t>{};
+    if constexpr (ranges::sized_range<Range>)
+    {
+        values.reserve(static_cast<size_t>(ranges::size(range)));
+    }
+    for (auto &&x : range)
+    {
+        auto result = std::invoke(func, std::forward<decltype(x)>(x));
+        if (!result.has_value())
+        {
+            return expect_t{tl::make_unexpected(std::move(result).error())};
+        }
+        values.push_back(std::move(result).value());
+    }
+    return expect_t{std::move(values)};
+}
+
 // sequence a list of monad
 template <
     template <typename T, typename...>
@@ -33,38 +65,24 @@ template <
     typename... Args>
 auto sequence(std::vector<M<T, Args...>> monads)
 {
-    return foldr(
-               [](M<T, Args...>              monad,
-                  M<std::vector<T>, Args...> acc) -> M<std::vector<T>, Args...>
-               {
-                   return monad >>= [acc](auto &&value)
-                   {
-                       return acc >>= [value](std::vector<T> acc_)
-                       {
-                           acc_.push_back(value);
-                           return Unit<M, Args...>(acc_);
-                       };
-                   };
-               },
-               Unit<M, Args...>(std::vector<T>()),
-               monads
-           ) >>= [](auto &&ret) -> M<std::vector<T>, Args...>
-    {
-        return std::move(ret) | ranges::actions::reverse;
-    };
+    return traverse(
+        std::move(monads),
+        [](M<T, Args...> &monad)
+        {
+            return std::move(monad);
+        }
+    );
 }
 
 template <typename T, typename Func>
 auto flatmap(std::vector<T> v, Func &&f)
 {
-    const auto mapped = v | ranges::views::transform(f) | ranges::to_vector;
-    return sequence(mapped);
+    return traverse(v, std::forward<Func>(f));
 }
 
 template <typename T, typename Func>
 auto flatmap_(std::vector<T> &v, Func &&f)
 {
-    const auto mapped = v | ranges::views::transform(f) | ranges::to_vector;
-    return sequence(mapped);
+    return traverse(v, std::forward<Func>(f));
 }
 } // namespace xi
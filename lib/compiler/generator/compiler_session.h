@@ -0,0 +1,89 @@
+#pragma once
+
+#include <compiler/ast/compile_cache.h>
+#include <compiler/ast/type_assign.h>
+#include <compiler/generator/llvm.h>
+
+namespace xi
+{
+
+// One compilation of a program, from type assignment to IR, objects or a run
+// in the JIT.
+//
+// A session has type assignment tables and a code generation context of its
+// own; sessions share only the symbol interner and the thread pool, both safe
+// to use from many threads. Each thread can then compile a program of its own
+// in a session of its own, with no global state to clear in between. A session
+// is used from one thread at a time.
+class CompilerSession
+{
+  public:
+    explicit CompilerSession(TargetCPU target = {})
+    {
+        SetTargetCPU(std::move(target), cg_);
+    }
+
+    // simplify each function as it is generated
+    void EnableFunctionPasses(llvm::OptimizationLevel level)
+    {
+        xi::EnableFunctionPasses(level, cg_);
+    }
+
+    // where the arrays of programs generated from now on live at run time
+    void SetAllocMode(AllocMode mode) { cg_.alloc_mode = mode; }
+
+    // let real arithmetic of programs generated from now on be reassociated
+    // and vectorized as if it were exact
+    void SetFastMath(bool fast_math) { cg_.fast_math = fast_math; }
+
+    auto TypeAssign(Xi_Program &program)
+        -> ExpectedTypeAssign<std::vector<type::Xi_Type>>
+    {
+        auto scope = TypeAssignScope(types_);
+        return xi::TypeAssign(program);
+    }
+
+    auto TypeAssign(Xi_Program &program, FunctionCache &cache)
+        -> ExpectedTypeAssign<std::vector<type::Xi_Type>>
+    {
+        auto scope = TypeAssignScope(types_);
+        return xi::TypeAssign(program, cache);
+    }
+
+    // generate the module for program, type assigned in this session
+    auto CodeGen(const Xi_Program &program) -> ExpectedCodeGen<std::string>
+    {
+        auto scope = TypeAssignScope(types_);
+        return xi::CodeGen(program, cg_);
+    }
+
+    auto CodeGen(const Xi_Program &program, FunctionCache &cache)
+        -> ExpectedCodeGen<std::string>
+    {
+        auto scope = TypeAssignScope(types_);
+        return xi::CodeGen(program, cache, cg_);
+    }
+
+    auto Optimize(llvm::OptimizationLevel level) -> ExpectedCodeGen<std::string>
+    {
+        return xi::Optimize(level, cg_);
+    }
+
+    auto GenObj(std::string_view output_file, unsigned partitions = 1)
+        -> ExpectedCodeGen<std::vector<std::string>>
+    {
+        return xi::GenObj(output_file, partitions, cg_);
+    }
+
+    // the module goes to the JIT, so generate it again before a second run
+    auto JITRunMain(bool lazy) -> ExpectedCodeGen<int64_t>
+    {
+        return xi::JITRunMain(lazy, cg_);
+    }
+
+  private:
+    TypeAssignState types_;
+    CodeGenContext  cg_;
+};
+
+} // namespace xi
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <compiler/ast/ast.h>
+#include <compiler/ast/fingerprint.h>
+#include <compiler/ast/type_assign.h>
+#include <compiler/generator/llvm.h>
+#include <string>
+#include <unordered_set>
+
+namespace xi
+{
+
+// A JIT that grows one input at a time, for the REPL.
+//
+// Each Define compiles only the new definitions into a module of their own
+// and adds it to the JIT; sets and declarations from earlier inputs are
+// declared again where the new code needs them, and set constructors already
+// in the JIT keep their first body. Each Evaluate compiles the expression as a
+// function of its own, calls it and shows the result. Work per input is
+// proportional to the input, not to everything defined before it.
+//
+// The session has type assignment tables and a code generation context of
+// its own, so it neither sees nor leaves behind the definitions of other
+// compilations in the process. An input that fails leaves the session as it
+// was before it.
+class JITSession
+{
+  public:
+    static auto Create() -> ExpectedCodeGen<JITSession>
+    {
+        return CreateJIT(false) >>=
+               [](std::unique_ptr<llvm::orc::LLJIT> &jit)
+                   -> ExpectedCodeGen<JITSession>
+        {
+            return JITSession(std::move(jit));
+        };
+    }
+
+    // add declarations, sets and functions
+    auto Define(Xi_Program &program) -> ExpectedCodeGen<std::monostate>
+    {
+        auto functions = std::vector<const Xi_Func *>{};
+        for (const auto &stmt : program.stmts)
+        {
+            if (const auto *func =
+                    std::get_if<recursive_wrapper<Xi_Func>>(&stmt))
+            {
+                functions.push_back(&func->get());
+            }
+            else if (!std::holds_alternative<Xi_Decl>(stmt) &&
+                     !std::holds_alternative<Xi_Set>(stmt) &&
+                     !std::holds_alternative<Xi_Comment>(stmt))
+            {
+                return tl::unexpected(ErrorCodeGen(
+                    ErrorCodeGen::NotImplemented,
+                    "only declarations, sets and functions can be defined"
+                ));
+            }
+        }
+        // the input is checked into a copy of the tables, which replaces them
+        // only once the JIT has its code, so an input that fails anywhere can
+        // be entered again
+        auto types = types_;
+        auto scope = TypeAssignScope(types);
+        auto typed = TypeAssign(program);
+        if (!typed)
+        {
+            return tl::unexpected(typeError(typed.error()));
+        }
+
+        InitializeModule(cg_);
+        cg_.function_effects = FunctionEffects(program);
+        return declareFor(functions) >>= [this, &program, &types](auto)
+        {
+            return traverse(
+                       program.stmts,
+                       [this](const auto &stmt)
+                       {
+                           return CodeGen(stmt, cg_);
+                       }
+                   ) >>= [this, &program, &types](auto)
+            {
+                return addModule() >>= [this, &program, &types](auto)
+                           -> ExpectedCodeGen<std::monostate>
+                {
+                    types_ = std::move(types);
+                    for (const auto &stmt : program.stmts)
+                    {
+                        if (std::holds_alternative<Xi_Decl>(stmt) ||
+                            std::holds_alternative<Xi_Set>(stmt))
+                        {
+                            interface_.stmts.push_back(stmt);
+                        }
+                    }
+                    return std::monostate{};
+                };
+            };
+        };
+    }
+
+    // evaluate expr against everything defined so far and show its value
+    auto Evaluate(Xi_Expr expr) -> ExpectedCodeGen<std::string>
+    {
+        auto scope = TypeAssignScope(types_);
+        auto typed = TypeAssign(expr);
+        if (!typed)
+        {
+            return tl::unexpected(typeError(typed.error()));
+        }
+        auto wrapper = Xi_Func{
+            .name   = fmt::format("__xi_expr_{}", expressions_++),
+            .params = {},
+            .expr   = expr,
+        };
+
+        InitializeModule(cg_);
+        return declareFor({&wrapper}) >>= [this, &wrapper, &typed](auto)
+        {
+            return shownType(*typed) >>= [this, &wrapper, &typed](
+                                             llvm::Type *return_type
+                                         )
+            {
+                auto *function = llvm::Function::Create(
+                    llvm::FunctionType::get(return_type, false),
+                    llvm::Function::ExternalLinkage,
+                    wrapper.name.str(),
+                    cg_.module.get()
+                );
+                // a buer comes back the way C returns a bool, zero extended,
+                // so call can read it through bool (*)()
+                if (return_type->isIntegerTy(1))
+                {
+                    function->addRetAttr(llvm::Attribute::ZExt);
+                }
+                cg_.builder->SetInsertPoint(
+                    llvm::BasicBlock::Create(*cg_.context, "entry", function)
+                );
+                cg_.named_values.clear();
+                return CodeGen(wrapper.expr, cg_) >>=
+                       [this, &wrapper, &typed](llvm::Value *value)
+                {
+                    cg_.builder->CreateRet(value);
+                    return addModule() >>= [this, &wrapper, &typed](auto)
+                    {
+                        return call(wrapper.name.str(), *typed);
+                    };
+                };
+            };
+        };
+    }
+
+  private:
+    explicit JITSession(std::unique_ptr<llvm::orc::LLJIT> jit) :
+        jit_(std::move(jit))
+    {
+    }
+
+    static auto typeError(TypeAssignError error) -> ErrorCodeGen
+    {
+        return ErrorCodeGen(ErrorCodeGen::TypeMismatch, error.what());
+    }
+
+    // the types an evaluated expression can be shown as
+    auto shownType(const type::Xi_Type &xi_t) -> ExpectedCodeGen<llvm::Type *>
+    {
+        if (std::holds_alternative<type::buer>(xi_t))
+        {
+            return llvm::Type::getInt1Ty(*cg_.context);
+        }
+        if (std::holds_alternative<type::i64>(xi_t) ||
+            std::holds_alternative<type::real>(xi_t) ||
+            std::holds_alternative<type::string>(xi_t))
+        {
+            return XiTypeToLLVMType(xi_t, cg_);
+        }
+        return tl::unexpected(ErrorCodeGen(
+            ErrorCodeGen::NotImplemented, fmt::format("show {}", xi_t)
+        ));
+    }
+
+    // declare into the current module every earlier set and the earlier
+    // declarations functions refer to
+    auto declareFor(const std::vector<const Xi_Func *> &functions)
+        -> ExpectedCodeGen<std::monostate>
+    {
+        auto references = std::unordered_set<Symbol>{};
+        for (const auto *func : functions)
+        {
+            for (auto name : References(*func))
+            {
+                references.insert(name);
+            }
+        }
+        for (const auto &stmt : interface_.stmts)
+        {
+            const auto *decl = std::get_if<Xi_Decl>(&stmt);
+            if (decl != nullptr && !references.contains(decl->name))
+            {
+                continue;
+            }
+            auto declared = CodeGen(stmt, cg_);
+            if (!declared)
+            {
+                return tl::unexpected(declared.error());
+            }
+        }
+        return std::monostate{};
+    }
+
+    // hand the current module to the JIT, dropping the bodies it already has;
+    // a module the verifier rejects is not added
+    auto addModule() -> ExpectedCodeGen<std::monostate>
+    {
+        std::string              message;
+        llvm::raw_string_ostream os(message);
+        if (llvm::verifyModule(*cg_.module, &os))
+        {
+            return tl::unexpected(ErrorCodeGen(ErrorCodeGen::Unknown, message)
+            );
+        }
+        auto added = std::vector<std::string>{};
+        for (auto &function : cg_.module->functions())
+        {
+            if (function.isDeclaration())
+            {
+                continue;
+            }
+            auto name = function.getName().str();
+            if (defined_.contains(name))
+            {
+                function.deleteBody();
+            }
+            else
+            {
+                added.push_back(std::move(name));
+            }
+        }
+        return AddModuleToJIT(*jit_, false, cg_) >>=
+               [this, &added](auto) -> ExpectedCodeGen<std::monostate>
+        {
+            defined_.insert(added.begin(), added.end());
+            return std::monostate{};
+        };
+    }
+
+    auto call(const std::string &name, const type::Xi_Type &xi_t)
+        -> ExpectedCodeGen<std::string>
+    {
+        auto show = [this, &name]<typename T>(T (*)(), auto format)
+        {
+            return LookupJIT<T()>(*jit_, name) >>=
+                   [&format](auto *function) -> ExpectedCodeGen<std::string>
+            {
+                return format(function());
+            };
+        };
+        auto plain = [](auto value)
+        {
+            return fmt::format("{}", value);
+        };
+        if (std::holds_alternative<type::i64>(xi_t))
+        {
+            return show(static_cast<int64_t (*)()>(nullptr), plain);
+        }
+        if (std::holds_alternative<type::real>(xi_t))
+        {
+            return show(static_cast<double (*)()>(nullptr), plain);
+        }
+        if (std::holds_alternative<type::buer>(xi_t))
+        {
+            return show(static_cast<bool (*)()>(nullptr), plain);
+        }
+        return show(
+            static_cast<const char *(*)()>(nullptr),
+            [](const char *value)
+            {
+                return fmt::format("\"{}\"", value);
+            }
+        );
+    }
+
+    TypeAssignState                   types_;
+    CodeGenContext                    cg_;
+    std::unique_ptr<llvm::orc::LLJIT> jit_;
+    // the sets and declarations defined so far
+    Xi_Program                        interface_;
+    // functions with a body in the JIT, set constructors included
+    std::unordered_set<std::string>   defined_;
+    size_t                            expressions_ = 0;
+};
+
+} // namespace xi
@@ -2,26 +2,47 @@
 
 #include <compiler/ast/ast.h>
 #include <compiler/ast/ast_format.h>
+#include <compiler/ast/compile_cache.h>
+#include <compiler/ast/escape.h>
+#include <compiler/ast/fingerprint.h>
+#include <compiler/ast/ownership.h>
+#include <compiler/ast/purity.h>
+#include <compiler/ast/tail_call.h>
 #include <compiler/ast/type.h>
+#include <compiler/ast/visit.h>
 #include <compiler/generator/error.h>
 #include <compiler/parser/basic_parsers.h>
 #include <compiler/utils/expected.h>
 #include <compiler/utils/recursive_wrapper.h>
+#include <filesystem>
 #include <llvm/ADT/APFloat.h>
 #include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/CodeGen/ParallelCG.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
@@ -31,26 +52,234 @@
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
 #include <map>
+#include <optional>
 #include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <unordered_set>
 #include <variant>
 
 namespace xi
 {
 using codegen_result_t = ExpectedCodeGen<llvm::Value *>;
 
-static std::unique_ptr<llvm::LLVMContext>        context;
-static std::unique_ptr<llvm::IRBuilder<>>        builder;
-static std::unique_ptr<llvm::Module>             module;
-static std::map<std::string, llvm::AllocaInst *> namedValues;
-constexpr int                                    llvm_int_precision = 64;
+constexpr int llvm_int_precision = 64;
 
-inline void InitializeModule()
+// Function simplification passes run on each function right after it is
+// generated, off unless EnableFunctionPasses is called. The analyses they
+// cache belong to the current module and are dropped with it.
+struct FunctionPasses
+{
+    // registered analyses refer back to the builder, so it goes last
+    llvm::PassBuilder             pass_builder;
+    llvm::LoopAnalysisManager     lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager    cgam;
+    llvm::ModuleAnalysisManager   mam;
+    llvm::FunctionPassManager     fpm;
+
+    explicit FunctionPasses(llvm::OptimizationLevel level)
+    {
+        pass_builder.registerModuleAnalyses(mam);
+        pass_builder.registerCGSCCAnalyses(cgam);
+        pass_builder.registerFunctionAnalyses(fam);
+        pass_builder.registerLoopAnalyses(lam);
+        pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+        fpm = pass_builder.buildFunctionSimplificationPipeline(
+            level, llvm::ThinOrFullLTOPhase::None
+        );
+    }
+};
+
+// The CPU code is generated for and the features it may use. The default,
+// "generic" with no extra features, runs on every host of the target triple.
+struct TargetCPU
+{
+    std::string cpu = "generic";
+    std::string features;
+    auto        operator==(const TargetCPU &) const -> bool = default;
+};
+
+// Where the arrays of a program live at run time. Malloc counts references
+// and frees each array with its last one; Arena takes them from a bump arena
+// of the thread that makes them, never freed before the process exits.
+enum class AllocMode
+{
+    Malloc,
+    Arena,
+};
+
+inline auto ParseAllocMode(std::string_view name) -> std::optional<AllocMode>
+{
+    if (name == "malloc")
+    {
+        return AllocMode::Malloc;
+    }
+    if (name == "arena")
+    {
+        return AllocMode::Arena;
+    }
+    return std::nullopt;
+}
+
+// What a name of the function being generated stands for. Parameters and lets
+// never change, so each is bound straight to its value. A variable, any name
+// of a function that assigns to names, or a set a call built in a let's
+// memory lives in a slot instead, and is loaded from it where it is used.
+struct Binding
+{
+    llvm::Value      *value = nullptr;
+    llvm::AllocaInst *slot  = nullptr;
+};
+
+// Everything one LLVM compilation works on. Each CodeGen takes the context to
+// generate into, so compilations with contexts of their own can run at once on
+// separate threads. The module, its builder and the function passes belong to
+// the LLVM context, so they are declared after it and go before it does.
+struct CodeGenContext
+{
+    std::unique_ptr<llvm::LLVMContext>       context;
+    std::unique_ptr<llvm::Module>            module;
+    std::unique_ptr<llvm::IRBuilder<>>       builder;
+    SymbolMap<Binding>                       named_values;
+    std::optional<llvm::OptimizationLevel>   function_pass_level;
+    std::unique_ptr<FunctionPasses>          function_passes;
+    TargetCPU                                target_cpu;
+    std::unique_ptr<llvm::TargetMachine>     target_machine;
+    AllocMode                                alloc_mode = AllocMode::Malloc;
+    // whether real arithmetic may be reassociated as if it were exact
+    bool                                     fast_math  = false;
+    // array literals of the program being generated that live in the frame
+    std::unordered_set<const Xi_Array *>     frame_arrays;
+    // what each function and constructor of that program may do
+    SymbolMap<Effects>                       function_effects;
+    // the counted values the function being generated owns, the uses in the
+    // expression it ends with that hand one on, and those handed on so far
+    std::vector<Symbol>                      owned_values;
+    std::unordered_set<const Xi_Iden *>      last_uses;
+    std::vector<Symbol>                      moved_values;
+    // the slots of the statement function being generated that hold counted
+    // values it owns: its parameters and its vars
+    std::vector<llvm::AllocaInst *>          owned_slots;
+    // the drop function of each array type in the module
+    std::map<llvm::Type *, llvm::Function *> drop_functions;
+};
+
+// simplify each function generated into cg from now on
+inline void
+EnableFunctionPasses(llvm::OptimizationLevel level, CodeGenContext &cg)
+{
+    cg.function_pass_level = level;
+    cg.function_passes.reset();
+}
+
+// every feature of the host, as +name and -name
+inline auto hostCPUFeatures() -> std::string
+{
+    llvm::StringMap<bool>   host;
+    llvm::SubtargetFeatures features;
+    if (llvm::sys::getHostCPUFeatures(host))
+    {
+        for (const auto &feature : host)
+        {
+            features.AddFeature(feature.first(), feature.second);
+        }
+    }
+    return features.getString();
+}
+
+// The target from -march, -mcpu and -mattr, empty when not given. -march and
+// -mcpu both name the CPU, -mcpu winning; "native" is the host's CPU with the
+// features the host reports. -mattr adds or removes features, as "+avx2,-fma".
+inline auto ParseTargetCPU(
+    std::string_view march, std::string_view mcpu, std::string_view mattr
+) -> TargetCPU
+{
+    auto target = TargetCPU{};
+    auto cpu    = mcpu.empty() ? march : mcpu;
+    if (cpu == "native")
+    {
+        target.cpu      = llvm::sys::getHostCPUName().str();
+        target.features = hostCPUFeatures();
+    }
+    else if (!cpu.empty())
+    {
+        target.cpu = cpu;
+    }
+    if (!mattr.empty())
+    {
+        target.features += target.features.empty() ? "" : ",";
+        target.features += mattr;
+    }
+    return target;
+}
+
+// generate for target from now on
+inline void SetTargetCPU(TargetCPU target, CodeGenContext &cg)
+{
+    cg.target_cpu = std::move(target);
+    cg.target_machine.reset();
+}
+
+// give function the target-cpu and target-features attributes of the chosen
+// target; with the default target they are removed, which leaves a JIT free to
+// tune for its host and drops any kept in cached IR
+inline void tuneFunction(llvm::Function &function, CodeGenContext &cg)
+{
+    if (cg.target_cpu == TargetCPU{})
+    {
+        function.removeFnAttr("target-cpu");
+        function.removeFnAttr("target-features");
+        return;
+    }
+    function.addFnAttr("target-cpu", cg.target_cpu.cpu);
+    if (cg.target_cpu.features.empty())
+    {
+        function.removeFnAttr("target-features");
+    }
+    else
+    {
+        function.addFnAttr("target-features", cg.target_cpu.features);
+    }
+}
+
+// run the function passes over a freshly generated function; functions the
+// verifier rejects are left for it to report
+inline void simplifyFunction(llvm::Function &function, CodeGenContext &cg)
+{
+    tuneFunction(function, cg);
+    if (!cg.function_pass_level ||
+        *cg.function_pass_level == llvm::OptimizationLevel::O0 ||
+        llvm::verifyFunction(function))
+    {
+        return;
+    }
+    if (cg.function_passes == nullptr)
+    {
+        cg.function_passes =
+            std::make_unique<FunctionPasses>(*cg.function_pass_level);
+    }
+    cg.function_passes->fpm.run(function, cg.function_passes->fam);
+}
+
+inline void InitializeModule(CodeGenContext &cg)
 {
     static const std::string moduleName = "xi module";
-    context                             = std::make_unique<llvm::LLVMContext>();
-    module  = std::make_unique<llvm::Module>(moduleName, *context);
-    builder = std::make_unique<llvm::IRBuilder<>>(*context);
-    namedValues.clear();
+    // a context frees the modules still in it, so the old module and builder
+    // go before their context does
+    cg.function_passes.reset();
+    cg.builder.reset();
+    cg.module.reset();
+    cg.context = std::make_unique<llvm::LLVMContext>();
+    cg.module = std::make_unique<llvm::Module>(moduleName, *cg.context);
+    cg.builder = std::make_unique<llvm::IRBuilder<>>(*cg.context);
+    if (cg.fast_math)
+    {
+        auto flags = llvm::FastMathFlags{};
+        flags.setFast();
+        cg.builder->setFastMathFlags(flags);
+    }
+    cg.named_values.clear();
+    cg.drop_functions.clear();
 }
 
 // CreateEntryBlockAlloca - Create an alloca instruction in the entry block of
@@ -65,115 +294,140 @@ static llvm::AllocaInst *CreateEntryBlockAlloca(
     return TmpB.CreateAlloca(t, 0, nullptr, VarName.c_str());
 }
 
-auto CodeGen(Xi_Expr expr) -> codegen_result_t;
-auto CodeGen(Xi_Stmt stmt) -> codegen_result_t;
+// the type of the value stored at slot
+inline auto slotType(llvm::Value *slot) -> llvm::Type *
+{
+    return slot->getType()->getNonOpaquePointerElementType();
+}
+
+inline auto bindingType(const Binding &binding) -> llvm::Type *
+{
+    return binding.slot != nullptr ? binding.slot->getAllocatedType()
+                                   : binding.value->getType();
+}
 
-template <typename T>
-auto CodeGen(recursive_wrapper<T> wrapper)
+// the value name is bound to, loaded if it lives in a slot
+auto bindingValue(const Binding &binding, Symbol name, CodeGenContext &cg)
+    -> llvm::Value *
 {
-    return CodeGen(wrapper.get());
+    return binding.slot != nullptr
+               ? cg.builder->CreateLoad(
+                     binding.slot->getAllocatedType(),
+                     binding.slot,
+                     name.c_str()
+                 )
+               : binding.value;
 }
 
-auto CodeGen(Xi_Real real) -> codegen_result_t
+auto CodeGen(const Xi_Expr &expr, CodeGenContext &cg) -> codegen_result_t;
+auto CodeGen(const Xi_Stmt &stmt, CodeGenContext &cg) -> codegen_result_t;
+
+auto CodeGen(const Xi_Real &real, CodeGenContext &cg) -> codegen_result_t
 {
     return (llvm::Value *)llvm::ConstantFP::get(
-        *context, llvm::APFloat(real.value)
+        *cg.context, llvm::APFloat(real.value)
     );
 }
 
-auto CodeGen(Xi_Integer integer) -> codegen_result_t
+auto CodeGen(const Xi_Integer &integer, CodeGenContext &cg) -> codegen_result_t
 {
     llvm::APSInt x;
     return llvm::ConstantInt::get(
-        *context,
+        *cg.context,
         llvm::APInt(
             llvm_int_precision, static_cast<uint64_t>(integer.value), true
         )
     );
 }
 
-auto CodeGen(Xi_Boolean boolean) -> codegen_result_t
+auto CodeGen(const Xi_Boolean &boolean, CodeGenContext &cg) -> codegen_result_t
 {
     return llvm::ConstantInt::get(
-        *context, llvm::APInt(1, static_cast<uint64_t>(boolean.value))
+        *cg.context, llvm::APInt(1, static_cast<uint64_t>(boolean.value))
     );
 }
 
-auto CodeGen(Xi_While wle) -> codegen_result_t
+auto CodeGen(const Xi_While &wle, CodeGenContext &cg) -> codegen_result_t
 {
-    llvm::Function *function = builder->GetInsertBlock()->getParent();
-    auto *cond_bb = llvm::BasicBlock::Create(*context, "cond", function);
-    builder->CreateBr(cond_bb);
-    builder->SetInsertPoint(cond_bb);
-    return CodeGen(wle.cond) >>=
-           [&function, wle, cond_bb](llvm::Value *end_cond) -> codegen_result_t
+    llvm::Function *function = cg.builder->GetInsertBlock()->getParent();
+    auto *cond_bb = llvm::BasicBlock::Create(*cg.context, "cond", function);
+    cg.builder->CreateBr(cond_bb);
+    cg.builder->SetInsertPoint(cond_bb);
+    return CodeGen(wle.cond, cg) >>=
+           [&function, &wle, cond_bb, &cg](llvm::Value *end_cond)
+               -> codegen_result_t
     {
         llvm::BasicBlock *loopbb =
-            llvm::BasicBlock::Create(*context, "loop", function);
+            llvm::BasicBlock::Create(*cg.context, "loop", function);
         auto *after_bb =
-            llvm::BasicBlock::Create(*context, "afterloop", function);
-        builder->CreateCondBr(end_cond, loopbb, after_bb);
-        builder->SetInsertPoint(loopbb);
-        return flatmap(
+            llvm::BasicBlock::Create(*cg.context, "afterloop", function);
+        cg.builder->CreateCondBr(end_cond, loopbb, after_bb);
+        cg.builder->SetInsertPoint(loopbb);
+        return traverse(
                    wle.body,
-                   [](auto x)
+                   [&cg](const auto &x)
                    {
-                       return CodeGen(x);
+                       return CodeGen(x, cg);
                    }
-               ) >>= [wle,
-                      after_bb,
-                      cond_bb](std::vector<llvm::Value *>) -> codegen_result_t
+               ) >>= [after_bb, cond_bb, &cg](std::vector<llvm::Value *>)
+                   -> codegen_result_t
         {
-            builder->CreateBr(cond_bb);
-            builder->SetInsertPoint(after_bb);
-            return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(*context
-            ));
+            cg.builder->CreateBr(cond_bb);
+            cg.builder->SetInsertPoint(after_bb);
+            return llvm::Constant::getNullValue(
+                llvm::Type::getDoubleTy(*cg.context)
+            );
         };
     };
 }
 
-auto XiTypeToLLVMType(type::Xi_Type xi_t) -> ExpectedCodeGen<llvm::Type *>
+// An arr[T] is passed around as the address of its elements and their count,
+// so its length is known wherever the array is.
+inline auto arrayType(llvm::Type *element_type, CodeGenContext &cg)
+    -> llvm::StructType *
+{
+    return llvm::StructType::get(
+        llvm::PointerType::get(element_type, 0),
+        llvm::Type::getInt64Ty(*cg.context)
+    );
+}
+
+auto XiTypeToLLVMType(const type::Xi_Type &xi_t, CodeGenContext &cg)
+    -> ExpectedCodeGen<llvm::Type *>
 {
     return std::visit(
-        []<typename T>(T t) -> ExpectedCodeGen<llvm::Type *>
+        [&cg]<typename T>(const T &t) -> ExpectedCodeGen<llvm::Type *>
         {
             if constexpr (std::same_as<T, type::real>)
             {
-                return llvm::Type::getDoubleTy(*context);
+                return llvm::Type::getDoubleTy(*cg.context);
             }
             else if constexpr (std::same_as<T, type::i64>)
             {
-                return llvm::Type::getInt64Ty(*context);
+                return llvm::Type::getInt64Ty(*cg.context);
             }
             else if constexpr (std::same_as<T, type::string>)
             {
                 return llvm::PointerType::get(
-                    llvm::Type::getInt8Ty(*context), 0
+                    llvm::Type::getInt8Ty(*cg.context), 0
                 );
             }
             else if constexpr (std::same_as<T, type::buer>)
             {
-                return llvm::PointerType::get(
-                    llvm::Type::getInt1Ty(*context), 0
-                );
+                return llvm::Type::getInt1Ty(*cg.context);
             }
             else if constexpr (std::same_as<T, recursive_wrapper<type::set>>)
             {
-                return llvm::StructType::getTypeByName(*context, t.get().name);
+                return llvm::StructType::getTypeByName(
+                    *cg.context, t.get().name
+                );
             }
             else if constexpr (std::same_as<T, recursive_wrapper<type::array>>)
             {
-                return XiTypeToLLVMType(t.get().inner_type) >>=
-                       [](auto inner_type) -> ExpectedCodeGen<llvm::Type *>
+                return XiTypeToLLVMType(t.get().inner_type, cg) >>=
+                       [&cg](auto inner_type) -> ExpectedCodeGen<llvm::Type *>
                 {
-                    // llvm::Type *intType = llvm::Type::getInt32Ty(*context);
-                    //
-                    // std::vector<llvm::Type *> types = {
-                    //     llvm::PointerType::get(inner_type, 0),
-                    //     intType,
-                    // };
-                    // return llvm::StructType::get(*context, types);
-                    return llvm::PointerType::get(inner_type, 0);
+                    return arrayType(inner_type, cg);
                 };
             }
             return tl::unexpected(
@@ -184,16 +438,17 @@ auto XiTypeToLLVMType(type::Xi_Type xi_t) -> ExpectedCodeGen<llvm::Type *>
     );
 }
 
-auto getArrayMemberType(Xi_Array arr) -> ExpectedCodeGen<llvm::Type *>
+auto getArrayMemberType(const Xi_Array &arr, CodeGenContext &cg)
+    -> ExpectedCodeGen<llvm::Type *>
 {
     return std::visit(
-        [](auto arr_) -> ExpectedCodeGen<llvm::Type *>
+        [&cg](const auto &arr_) -> ExpectedCodeGen<llvm::Type *>
         {
             if constexpr (std::same_as<
                               std::decay_t<decltype(arr_)>,
                               recursive_wrapper<type::array>>)
             {
-                return XiTypeToLLVMType(arr_.get().inner_type);
+                return XiTypeToLLVMType(arr_.get().inner_type, cg);
             }
             return tl::unexpected(ErrorCodeGen(
                 ErrorCodeGen::TypeMismatch,
@@ -204,98 +459,783 @@ auto getArrayMemberType(Xi_Array arr) -> ExpectedCodeGen<llvm::Type *>
     );
 }
 
-auto CodeGen(Xi_Array arr) -> codegen_result_t
+// the array of length elements starting at elements
+auto makeArray(
+    llvm::Type     *element_type,
+    llvm::Value    *elements,
+    llvm::Value    *length,
+    CodeGenContext &cg
+) -> llvm::Value *
+{
+    auto *array = llvm::UndefValue::get(arrayType(element_type, cg));
+    return cg.builder->CreateInsertValue(
+        cg.builder->CreateInsertValue(array, elements, 0), length, 1, "array"
+    );
+}
+
+// whether values of type hold arrays, whose references are counted
+inline auto isCounted(llvm::Type *type) -> bool
+{
+    auto *struct_type = llvm::dyn_cast<llvm::StructType>(type);
+    return struct_type != nullptr &&
+           (struct_type->isLiteral() ||
+            std::ranges::any_of(struct_type->elements(), isCounted));
+}
+
+// Type-based alias tags keep the memory of arrays apart: their elements, one
+// tag per element type, and the reference counts before them. An array's
+// memory only ever holds elements of its one type, so LLVM need not load an
+// element again after a store of another type or to a count.
+auto aliasTag(llvm::StringRef name, CodeGenContext &cg) -> llvm::MDNode *
+{
+    auto  metadata = llvm::MDBuilder(*cg.context);
+    auto *type     = metadata.createTBAAScalarTypeNode(
+        name, metadata.createTBAARoot("xi")
+    );
+    return metadata.createTBAAStructTagNode(type, type, 0);
+}
+
+// the name of the type of values of type, the same in every module; a set
+// created again in one LLVM context is renamed set.1
+auto tagName(llvm::Type *type) -> std::string
 {
-    return getArrayMemberType(arr) >>=
-           [arr](llvm::Type *element_type) -> codegen_result_t
+    if (auto *struct_type = llvm::dyn_cast<llvm::StructType>(type))
     {
-        auto *int32type    = llvm::Type::getInt32Ty(*context);
-        auto *element_size = llvm::ConstantInt::get(
-            int32type, module->getDataLayout().getTypeAllocSize(element_type)
-        );
-        // TODO(ding.wang): get size in run time
-        // auto *alloc_size = llvm::ConstantExpr::getMul(
-        //     llvm::ConstantInt::get(int32type, arr.elements.size()),
-        //     element_size
-        // );
-        auto array_size = llvm::ConstantInt::get(int32type, 100);
-
-        auto  bb       = builder->GetInsertBlock();
-        auto *arr_code = llvm::CallInst::CreateMalloc(
-            bb,
-            llvm::PointerType::getUnqual(element_type),
-            element_type,
-            element_size,
-            array_size,
+        return struct_type->isLiteral()
+                   ? fmt::format(
+                         "arr[{}]",
+                         tagName(struct_type->getElementType(0)
+                                     ->getNonOpaquePointerElementType())
+                     )
+                   : struct_type->getName().split('.').first.str();
+    }
+    std::string              name;
+    llvm::raw_string_ostream os(name);
+    type->print(os);
+    return name;
+}
+
+auto elementTag(llvm::Type *element_type, CodeGenContext &cg) -> llvm::MDNode *
+{
+    return aliasTag(tagName(element_type), cg);
+}
+
+auto countTag(CodeGenContext &cg) -> llvm::MDNode *
+{
+    return aliasTag("count", cg);
+}
+
+// the load or store access, tagged as touching memory of the kind tag names
+template <typename Access>
+auto tagged(Access *access, llvm::MDNode *tag) -> Access *
+{
+    access->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+    return access;
+}
+
+// The i64 just before the elements of an array counts the references to it.
+// A count of 0 is never changed, so an array kept in a frame is never freed.
+auto countPointer(llvm::Value *array, CodeGenContext &cg) -> llvm::Value *
+{
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *elements  = cg.builder->CreateBitCast(
+        cg.builder->CreateExtractValue(array, 0), int64type->getPointerTo()
+    );
+    return cg.builder->CreateInBoundsGEP(
+        int64type,
+        elements,
+        llvm::ConstantInt::getSigned(int64type, -1),
+        "count_ptr"
+    );
+}
+
+// take one more reference to each array in value
+void dupValue(llvm::Value *value, CodeGenContext &cg)
+{
+    auto *type = value->getType();
+    if (cg.alloc_mode == AllocMode::Arena || !isCounted(type))
+    {
+        return;
+    }
+    auto *struct_type = llvm::cast<llvm::StructType>(type);
+    if (!struct_type->isLiteral())
+    {
+        for (unsigned i = 0; i < struct_type->getNumElements(); i++)
+        {
+            if (isCounted(struct_type->getElementType(i)))
+            {
+                dupValue(cg.builder->CreateExtractValue(value, i), cg);
+            }
+        }
+        return;
+    }
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *count_ptr = countPointer(value, cg);
+    auto *count     = tagged(
+        cg.builder->CreateLoad(int64type, count_ptr, "count"), countTag(cg)
+    );
+    auto *counted = cg.builder->CreateZExt(
+        cg.builder->CreateICmpNE(count, llvm::ConstantInt::get(int64type, 0)),
+        int64type
+    );
+    tagged(
+        cg.builder->CreateStore(
+            cg.builder->CreateAdd(count, counted), count_ptr
+        ),
+        countTag(cg)
+    );
+}
+
+auto dropFunction(llvm::StructType *array_type, CodeGenContext &cg)
+    -> llvm::Function *;
+
+// give up a reference to each array in value
+void dropValue(llvm::Value *value, CodeGenContext &cg)
+{
+    auto *type = value->getType();
+    if (cg.alloc_mode == AllocMode::Arena || !isCounted(type))
+    {
+        return;
+    }
+    auto *struct_type = llvm::cast<llvm::StructType>(type);
+    if (struct_type->isLiteral())
+    {
+        cg.builder->CreateCall(dropFunction(struct_type, cg), {value});
+        return;
+    }
+    for (unsigned i = 0; i < struct_type->getNumElements(); i++)
+    {
+        if (isCounted(struct_type->getElementType(i)))
+        {
+            dropValue(cg.builder->CreateExtractValue(value, i), cg);
+        }
+    }
+}
+
+// drop what the elements of array refer to, before its memory is freed or
+// used again
+void dropElements(llvm::Value *array, CodeGenContext &cg)
+{
+    auto *elements     = cg.builder->CreateExtractValue(array, 0);
+    auto *element_type = elements->getType()->getNonOpaquePointerElementType();
+    if (!isCounted(element_type))
+    {
+        return;
+    }
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *length    = cg.builder->CreateExtractValue(array, 1);
+    auto *function  = cg.builder->GetInsertBlock()->getParent();
+    auto *before    = cg.builder->GetInsertBlock();
+    auto *loop_bb =
+        llvm::BasicBlock::Create(*cg.context, "drop_elements", function);
+    auto *body_bb =
+        llvm::BasicBlock::Create(*cg.context, "drop_element", function);
+    auto *after_bb =
+        llvm::BasicBlock::Create(*cg.context, "dropped_elements", function);
+    cg.builder->CreateBr(loop_bb);
+
+    cg.builder->SetInsertPoint(loop_bb);
+    auto *i = cg.builder->CreatePHI(int64type, 2, "i");
+    i->addIncoming(llvm::ConstantInt::get(int64type, 0), before);
+    cg.builder->CreateCondBr(
+        cg.builder->CreateICmpSLT(i, length), body_bb, after_bb
+    );
+
+    cg.builder->SetInsertPoint(body_bb);
+    dropValue(
+        tagged(
+            cg.builder->CreateLoad(
+                element_type,
+                cg.builder->CreateInBoundsGEP(element_type, elements, i)
+            ),
+            elementTag(element_type, cg)
+        ),
+        cg
+    );
+    i->addIncoming(
+        cg.builder->CreateAdd(i, llvm::ConstantInt::get(int64type, 1)),
+        cg.builder->GetInsertBlock()
+    );
+    cg.builder->CreateBr(loop_bb);
+    cg.builder->SetInsertPoint(after_bb);
+}
+
+// The function giving up a reference to an array of array_type: it counts
+// the reference off, and frees the array with the last one. There is one per
+// array type in each module, made on first use.
+auto dropFunction(llvm::StructType *array_type, CodeGenContext &cg)
+    -> llvm::Function *
+{
+    auto *&drop = cg.drop_functions[array_type];
+    if (drop != nullptr)
+    {
+        return drop;
+    }
+    drop = llvm::Function::Create(
+        llvm::FunctionType::get(
+            llvm::Type::getVoidTy(*cg.context), {array_type}, false
+        ),
+        llvm::Function::InternalLinkage,
+        "xi.drop",
+        cg.module.get()
+    );
+    tuneFunction(*drop, cg);
+    auto guard = llvm::IRBuilderBase::InsertPointGuard(*cg.builder);
+
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *entry     = llvm::BasicBlock::Create(*cg.context, "entry", drop);
+    auto *count_off = llvm::BasicBlock::Create(*cg.context, "count_off", drop);
+    auto *free_bb   = llvm::BasicBlock::Create(*cg.context, "free", drop);
+    auto *done      = llvm::BasicBlock::Create(*cg.context, "done", drop);
+    cg.builder->SetInsertPoint(entry);
+    auto *array     = drop->getArg(0);
+    auto *count_ptr = countPointer(array, cg);
+    auto *count     = tagged(
+        cg.builder->CreateLoad(int64type, count_ptr, "count"), countTag(cg)
+    );
+    auto *choice = cg.builder->CreateSwitch(count, count_off, 2);
+    choice->addCase(llvm::ConstantInt::get(int64type, 0), done);
+    choice->addCase(llvm::ConstantInt::get(int64type, 1), free_bb);
+
+    cg.builder->SetInsertPoint(count_off);
+    tagged(
+        cg.builder->CreateStore(
+            cg.builder->CreateSub(count, llvm::ConstantInt::get(int64type, 1)),
+            count_ptr
+        ),
+        countTag(cg)
+    );
+    cg.builder->CreateBr(done);
+
+    cg.builder->SetInsertPoint(free_bb);
+    dropElements(array, cg);
+    auto *int8ptr = llvm::Type::getInt8PtrTy(*cg.context);
+    auto  free    = cg.module->getOrInsertFunction(
+        "free", llvm::Type::getVoidTy(*cg.context), int8ptr
+    );
+    cg.builder->CreateCall(
+        free, {cg.builder->CreateBitCast(count_ptr, int8ptr)}
+    );
+    cg.builder->CreateBr(done);
+
+    cg.builder->SetInsertPoint(done);
+    cg.builder->CreateRetVoid();
+    return drop;
+}
+
+// Each thread bumps a pointer through chunks of arena_chunk bytes, or of the
+// size asked for rounded up to whole huge pages if that is more. A chunk asks
+// for huge pages first, and falls back to pages the kernel may merge into
+// huge ones. The program aborts when neither can be mapped.
+inline constexpr uint64_t arena_chunk     = uint64_t{64} << 20;
+inline constexpr uint64_t arena_huge_page = uint64_t{2} << 20;
+inline constexpr uint64_t arena_align     = 16;
+
+// The function taking size bytes from the arena of the calling thread. One
+// copy of it and of the arena is kept however many modules define them.
+auto arenaFunction(CodeGenContext &cg) -> llvm::Function *
+{
+    static const auto *name = "xi.arena.alloc";
+    if (auto *arena = cg.module->getFunction(name))
+    {
+        return arena;
+    }
+    auto *int8ptr   = llvm::Type::getInt8PtrTy(*cg.context);
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *int32type = llvm::Type::getInt32Ty(*cg.context);
+    auto  global    = [int8ptr, &cg](const char *global_name)
+    {
+        return new llvm::GlobalVariable(
+            *cg.module,
+            int8ptr,
+            false,
+            llvm::GlobalValue::LinkOnceODRLinkage,
+            llvm::ConstantPointerNull::get(int8ptr),
+            global_name,
             nullptr,
-            "malloc"
+            llvm::GlobalValue::InitialExecTLSModel
+        );
+    };
+    auto *next_ptr = global("xi.arena.next");
+    auto *end_ptr  = global("xi.arena.end");
+    auto *arena    = llvm::Function::Create(
+        llvm::FunctionType::get(int8ptr, {int64type}, false),
+        llvm::Function::LinkOnceODRLinkage,
+        name,
+        cg.module.get()
+    );
+    // like malloc, it never hands out memory anything else points to
+    arena->addRetAttr(llvm::Attribute::NoAlias);
+    tuneFunction(*arena, cg);
+    auto guard = llvm::IRBuilderBase::InsertPointGuard(*cg.builder);
+    auto constant = [int64type](uint64_t value)
+    {
+        return llvm::ConstantInt::get(int64type, value);
+    };
+
+    auto *entry    = llvm::BasicBlock::Create(*cg.context, "entry", arena);
+    auto *bump_bb  = llvm::BasicBlock::Create(*cg.context, "bump", arena);
+    auto *chunk_bb = llvm::BasicBlock::Create(*cg.context, "chunk", arena);
+    auto *small_bb = llvm::BasicBlock::Create(*cg.context, "small", arena);
+    auto *failed_bb =
+        llvm::BasicBlock::Create(*cg.context, "map_failed", arena);
+    auto *got_bb = llvm::BasicBlock::Create(*cg.context, "got", arena);
+    cg.builder->SetInsertPoint(entry);
+    auto *size = cg.builder->CreateAnd(
+        cg.builder->CreateAdd(arena->getArg(0), constant(arena_align - 1)),
+        constant(~(arena_align - 1)),
+        "size"
+    );
+    auto *next = cg.builder->CreateLoad(int8ptr, next_ptr, "next");
+    auto *end  = cg.builder->CreateLoad(int8ptr, end_ptr, "end");
+    auto *left = cg.builder->CreateSub(
+        cg.builder->CreatePtrToInt(end, int64type),
+        cg.builder->CreatePtrToInt(next, int64type),
+        "left"
+    );
+    cg.builder->CreateCondBr(
+        cg.builder->CreateICmpULE(size, left), bump_bb, chunk_bb
+    );
+
+    cg.builder->SetInsertPoint(bump_bb);
+    cg.builder->CreateStore(
+        cg.builder->CreateInBoundsGEP(
+            llvm::Type::getInt8Ty(*cg.context), next, size
+        ),
+        next_ptr
+    );
+    cg.builder->CreateRet(next);
+
+    // what is left of the current chunk is given up
+    cg.builder->SetInsertPoint(chunk_bb);
+    auto *chunk_size = cg.builder->CreateSelect(
+        cg.builder->CreateICmpUGT(size, constant(arena_chunk)),
+        cg.builder->CreateAnd(
+            cg.builder->CreateAdd(size, constant(arena_huge_page - 1)),
+            constant(~(arena_huge_page - 1))
+        ),
+        constant(arena_chunk),
+        "chunk_size"
+    );
+    auto mmap_function = cg.module->getOrInsertFunction(
+        "mmap",
+        int8ptr,
+        int8ptr,
+        int64type,
+        int32type,
+        int32type,
+        int32type,
+        int64type
+    );
+    auto map_chunk =
+        [&mmap_function, chunk_size, int8ptr, int32type, int64type, &cg](
+            int flags
+        )
+    {
+        return cg.builder->CreateCall(
+            mmap_function,
+            {llvm::ConstantPointerNull::get(int8ptr),
+             chunk_size,
+             llvm::ConstantInt::get(int32type, PROT_READ | PROT_WRITE),
+             llvm::ConstantInt::get(
+                 int32type, MAP_PRIVATE | MAP_ANONYMOUS | flags
+             ),
+             llvm::ConstantInt::getSigned(int32type, -1),
+             llvm::ConstantInt::get(int64type, 0)},
+            "memory"
         );
+    };
+    auto *map_failed = cg.builder->CreateIntToPtr(
+        llvm::ConstantInt::getSigned(int64type, -1), int8ptr
+    );
+#ifdef MAP_HUGETLB
+    auto *huge = map_chunk(MAP_HUGETLB);
+    cg.builder->CreateCondBr(
+        cg.builder->CreateICmpEQ(huge, map_failed), small_bb, got_bb
+    );
+#else
+    cg.builder->CreateBr(small_bb);
+#endif
+
+    cg.builder->SetInsertPoint(small_bb);
+    auto *small = map_chunk(0);
+#ifdef MADV_HUGEPAGE
+    cg.builder->CreateCall(
+        cg.module->getOrInsertFunction(
+            "madvise", int32type, int8ptr, int64type, int32type
+        ),
+        {small, chunk_size, llvm::ConstantInt::get(int32type, MADV_HUGEPAGE)}
+    );
+#endif
+    cg.builder->CreateCondBr(
+        cg.builder->CreateICmpEQ(small, map_failed), failed_bb, got_bb
+    );
+
+    cg.builder->SetInsertPoint(failed_bb);
+    cg.builder->CreateCall(cg.module->getOrInsertFunction(
+        "abort", llvm::Type::getVoidTy(*cg.context)
+    ));
+    cg.builder->CreateUnreachable();
+
+    cg.builder->SetInsertPoint(got_bb);
+    auto *memory = cg.builder->CreatePHI(int8ptr, 2, "memory");
+#ifdef MAP_HUGETLB
+    memory->addIncoming(huge, chunk_bb);
+#endif
+    memory->addIncoming(small, small_bb);
+    auto *int8type = llvm::Type::getInt8Ty(*cg.context);
+    cg.builder->CreateStore(
+        cg.builder->CreateInBoundsGEP(int8type, memory, size), next_ptr
+    );
+    cg.builder->CreateStore(
+        cg.builder->CreateInBoundsGEP(int8type, memory, chunk_size), end_ptr
+    );
+    cg.builder->CreateRet(memory);
+    return arena;
+}
 
-        auto *p = builder->Insert(arr_code);
+// a new array of length elements of element_type, length an i64 known only
+// at run time, with one reference; the elements are left for the caller to
+// store. An array from the arena has a count of 0, as it is never freed.
+auto allocArray(
+    llvm::Type *element_type, llvm::Value *length, CodeGenContext &cg
+) -> llvm::Value *
+{
+    auto       *int64type   = llvm::Type::getInt64Ty(*cg.context);
+    const auto &data_layout = cg.module->getDataLayout();
+    auto       *count_size  = llvm::ConstantInt::get(
+        int64type, data_layout.getTypeAllocSize(int64type)
+    );
+    auto *size = cg.builder->CreateAdd(
+        cg.builder->CreateMul(
+            length,
+            llvm::ConstantInt::get(
+                int64type, data_layout.getTypeAllocSize(element_type)
+            )
+        ),
+        count_size
+    );
+    auto  from_arena = cg.alloc_mode == AllocMode::Arena;
+    auto *memory     = from_arena
+                           ? cg.builder->CreateCall(arenaFunction(cg), {size})
+                           : cg.builder->Insert(llvm::CallInst::CreateMalloc(
+                                 cg.builder->GetInsertBlock(),
+                                 int64type,
+                                 llvm::Type::getInt8Ty(*cg.context),
+                                 llvm::ConstantInt::get(int64type, 1),
+                                 size,
+                                 nullptr,
+                                 "malloc"
+                             ));
+    tagged(
+        cg.builder->CreateStore(
+            llvm::ConstantInt::get(int64type, from_arena ? 0 : 1),
+            cg.builder->CreateBitCast(memory, int64type->getPointerTo())
+        ),
+        countTag(cg)
+    );
+    auto *elements = cg.builder->CreateBitCast(
+        cg.builder->CreateInBoundsGEP(
+            llvm::Type::getInt8Ty(*cg.context), memory, count_size
+        ),
+        element_type->getPointerTo()
+    );
+    return makeArray(element_type, elements, length, cg);
+}
+
+// an array of length elements in the frame of the function being generated,
+// which must not outlive it
+auto allocFrameArray(
+    llvm::Type *element_type, uint64_t length, CodeGenContext &cg
+) -> llvm::Value *
+{
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *function  = cg.builder->GetInsertBlock()->getParent();
+    auto *storage   = CreateEntryBlockAlloca(
+        function,
+        "array",
+        llvm::StructType::get(
+            int64type, llvm::ArrayType::get(element_type, length)
+        )
+    );
+    cg.builder->CreateStore(
+        llvm::ConstantInt::get(int64type, 0),
+        cg.builder->CreateStructGEP(storage->getAllocatedType(), storage, 0)
+    );
+    auto *elements = cg.builder->CreateInBoundsGEP(
+        storage->getAllocatedType(),
+        storage,
+        {cg.builder->getInt32(0),
+         cg.builder->getInt32(1),
+         cg.builder->getInt64(0)}
+    );
+    return makeArray(
+        element_type, elements, llvm::ConstantInt::get(int64type, length), cg
+    );
+}
+
+// The memory of array, which the caller gives up, for a new array of length
+// elements of the same type: it is used again if nothing else refers to array
+// and the lengths agree, so an array made from the last reference to one
+// like it is updated in place. Otherwise array is dropped and the new one
+// gets memory of its own.
+auto reuseArray(llvm::Value *array, uint64_t length, CodeGenContext &cg)
+    -> llvm::Value *
+{
+    auto *int64type    = llvm::Type::getInt64Ty(*cg.context);
+    auto *element_type = array->getType()->getStructElementType(0)
+                             ->getNonOpaquePointerElementType();
+    auto *new_length = llvm::ConstantInt::get(int64type, length);
+    auto *count      = tagged(
+        cg.builder->CreateLoad(int64type, countPointer(array, cg), "count"),
+        countTag(cg)
+    );
+    auto *unique = cg.builder->CreateAnd(
+        cg.builder->CreateICmpEQ(count, llvm::ConstantInt::get(int64type, 1)),
+        cg.builder->CreateICmpEQ(
+            cg.builder->CreateExtractValue(array, 1), new_length
+        ),
+        "unique"
+    );
+    auto *function = cg.builder->GetInsertBlock()->getParent();
+    auto *reuse_bb = llvm::BasicBlock::Create(*cg.context, "reuse", function);
+    auto *fresh_bb = llvm::BasicBlock::Create(*cg.context, "fresh", function);
+    auto *join_bb  = llvm::BasicBlock::Create(*cg.context, "reused", function);
+    cg.builder->CreateCondBr(unique, reuse_bb, fresh_bb);
+
+    cg.builder->SetInsertPoint(reuse_bb);
+    dropElements(array, cg);
+    cg.builder->CreateBr(join_bb);
+    reuse_bb = cg.builder->GetInsertBlock();
+
+    cg.builder->SetInsertPoint(fresh_bb);
+    dropValue(array, cg);
+    auto *fresh = allocArray(element_type, new_length, cg);
+    cg.builder->CreateBr(join_bb);
+
+    cg.builder->SetInsertPoint(join_bb);
+    auto *result = cg.builder->CreatePHI(array->getType(), 2, "array");
+    result->addIncoming(array, reuse_bb);
+    result->addIncoming(fresh, fresh_bb);
+    return result;
+}
 
-        // assign value
-        for (uint64_t i = 0; i < arr.elements.size(); i++)
+// generate the elements of arr and store them into the array alloc gives for
+// their type and number
+template <typename Alloc>
+auto codeGenArray(const Xi_Array &arr, Alloc alloc, CodeGenContext &cg)
+    -> codegen_result_t
+{
+    return getArrayMemberType(arr, cg) >>=
+           [&arr, &alloc, &cg](llvm::Type *element_type)
+    {
+        return traverse(
+                   arr.elements,
+                   [&cg](const auto &element)
+                   {
+                       return CodeGen(element, cg);
+                   }
+               ) >>= [element_type, &alloc, &cg](
+                         std::vector<llvm::Value *> values
+                     ) -> codegen_result_t
         {
-            auto *idx = llvm::ConstantInt::get(int32type, i);
-            auto *gep = builder->CreateGEP(element_type, p, idx);
-            builder->CreateStore(CodeGen(arr.elements[i]).value(), gep);
-        }
-        // module->print(llvm::errs(), nullptr);
-        return p;
+            // the elements move into the array, which now holds their
+            // references
+            auto *array    = alloc(element_type, values.size());
+            auto *elements = cg.builder->CreateExtractValue(array, 0);
+            for (uint64_t i = 0; i < values.size(); i++)
+            {
+                auto *element_ptr = cg.builder->CreateConstInBoundsGEP1_64(
+                    element_type, elements, i
+                );
+                tagged(
+                    cg.builder->CreateStore(values[i], element_ptr),
+                    elementTag(element_type, cg)
+                );
+            }
+            return array;
+        };
     };
 }
 
+// A literal that does not escape lives in the frame unless its elements hold
+// counted arrays: nothing drops the elements of an array with a count of 0,
+// so they would never be freed.
+auto CodeGen(const Xi_Array &arr, CodeGenContext &cg) -> codegen_result_t
+{
+    return codeGenArray(
+        arr,
+        [&arr, &cg](llvm::Type *element_type, uint64_t length)
+        {
+            auto in_frame = cg.frame_arrays.contains(&arr) &&
+                            (cg.alloc_mode == AllocMode::Arena ||
+                             !isCounted(element_type));
+            return in_frame
+                       ? allocFrameArray(element_type, length, cg)
+                       : allocArray(
+                             element_type,
+                             llvm::ConstantInt::get(
+                                 llvm::Type::getInt64Ty(*cg.context), length
+                             ),
+                             cg
+                         );
+        },
+        cg
+    );
+}
+
+// A set larger than two registers is returned the way C returns it: the
+// caller gives the address to build it at as the first argument (sret), so it
+// is written once where it is wanted instead of being returned in pieces and
+// stored again.
+inline constexpr uint64_t register_set_size = 16;
+
+inline auto inMemory(llvm::Type *type, CodeGenContext &cg) -> bool
+{
+    auto *struct_type = llvm::dyn_cast<llvm::StructType>(type);
+    return struct_type != nullptr && !struct_type->isLiteral() &&
+           cg.module->getDataLayout().getTypeAllocSize(type) >
+               register_set_size;
+}
+
+// declare a function taking param_types to return_type, which it builds at
+// an address it is given if that goes through memory
+auto createFunction(
+    std::string_view                 name,
+    llvm::Type                      *return_type,
+    const std::vector<llvm::Type *> &param_types,
+    bool                             is_vararg,
+    CodeGenContext                  &cg
+) -> llvm::Function *
+{
+    if (!inMemory(return_type, cg))
+    {
+        return llvm::Function::Create(
+            llvm::FunctionType::get(return_type, param_types, is_vararg),
+            llvm::Function::ExternalLinkage,
+            name,
+            cg.module.get()
+        );
+    }
+    auto arg_types = param_types;
+    arg_types.insert(arg_types.begin(), llvm::PointerType::get(return_type, 0));
+    auto *function = llvm::Function::Create(
+        llvm::FunctionType::get(
+            llvm::Type::getVoidTy(*cg.context), arg_types, is_vararg
+        ),
+        llvm::Function::ExternalLinkage,
+        name,
+        cg.module.get()
+    );
+    function->addParamAttr(
+        0, llvm::Attribute::getWithStructRetType(*cg.context, return_type)
+    );
+    function->addParamAttr(0, llvm::Attribute::NoAlias);
+    return function;
+}
+
+// Tell LLVM what function may do if the program defines it as name. None
+// unwinds, and the address of its result is only written. A pure one touches
+// no other memory, so calls of it with the same arguments can be merged, moved
+// or dropped. Functions defined elsewhere are left as they are.
+void markEffects(llvm::Function &function, Symbol name, CodeGenContext &cg)
+{
+    const auto *effects = cg.function_effects.find(name);
+    if (effects == nullptr)
+    {
+        return;
+    }
+    function.addFnAttr(llvm::Attribute::NoUnwind);
+    if (function.hasStructRetAttr())
+    {
+        function.addParamAttr(0, llvm::Attribute::NoCapture);
+        function.addParamAttr(0, llvm::Attribute::WriteOnly);
+    }
+    if (!effects->pure)
+    {
+        return;
+    }
+    function.addFnAttr(
+        function.hasStructRetAttr() ? llvm::Attribute::ArgMemOnly
+                                    : llvm::Attribute::ReadNone
+    );
+    if (effects->returns)
+    {
+        function.addFnAttr(llvm::Attribute::WillReturn);
+    }
+}
+
 // generate user defined type
-auto CodeGen(Xi_Set set) -> codegen_result_t
+auto CodeGen(const Xi_Set &set, CodeGenContext &cg) -> codegen_result_t
 {
-    auto set_type     = std::get<recursive_wrapper<type::set>>(set.type).get();
+    const auto &set_type =
+        std::get<recursive_wrapper<type::set>>(set.type).get();
     auto member_types = set_type.members |
                         ranges::views::transform(
-                            [](auto pair)
+                            [](const auto &pair)
                             {
                                 return pair.second;
                             }
                         ) |
                         ranges::to_vector;
-    return flatmap(member_types, XiTypeToLLVMType) >>=
-           [set](std::vector<llvm::Type *> llvm_members_type
+    auto to_llvm = [&cg](const auto &member_type)
+    {
+        return XiTypeToLLVMType(member_type, cg);
+    };
+    return traverse(member_types, to_llvm) >>=
+           [&set, &cg](std::vector<llvm::Type *> llvm_members_type
            ) -> codegen_result_t
     {
-        auto *struct_type =
-            llvm::StructType::create(*context, llvm_members_type, set.name);
+        auto *struct_type = llvm::StructType::create(
+            *cg.context, llvm_members_type, set.name.str()
+        );
         // generate constructor
-        auto *constructor = llvm::Function::Create(
-            llvm::FunctionType::get(struct_type, llvm_members_type, false),
-            llvm::Function::ExternalLinkage,
-            set.name,
-            module.get()
+        auto *constructor = createFunction(
+            set.name.str(), struct_type, llvm_members_type, false, cg
         );
-
-        auto *entry = llvm::BasicBlock::Create(*context, "entry", constructor);
-        builder->SetInsertPoint(entry);
-        // create struct in stack
-        auto *struct_ptr = builder->CreateAlloca(struct_type);
+        markEffects(*constructor, set.name, cg);
+
+        auto *entry =
+            llvm::BasicBlock::Create(*cg.context, "entry", constructor);
+        cg.builder->SetInsertPoint(entry);
+        // a set in memory is built where the caller wants it, any other in
+        // the constructor's frame
+        auto  sret       = constructor->hasStructRetAttr();
+        auto *struct_ptr =
+            sret ? static_cast<llvm::Value *>(constructor->getArg(0))
+                 : cg.builder->CreateAlloca(struct_type);
 
         unsigned int i = 0;
         for (auto &arg : constructor->args())
         {
-            auto *field = builder->CreateStructGEP(struct_type, struct_ptr, i);
+            if (arg.hasStructRetAttr())
+            {
+                continue;
+            }
+            auto *field =
+                cg.builder->CreateStructGEP(struct_type, struct_ptr, i);
             i += 1;
-            builder->CreateStore(&arg, field);
+            cg.builder->CreateStore(&arg, field);
+        }
+        if (sret)
+        {
+            cg.builder->CreateRetVoid();
+            return constructor;
         }
         // return struct
-        llvm::Value *struct_val = builder->CreateLoad(struct_type, struct_ptr);
-        builder->CreateRet(struct_val);
+        llvm::Value *struct_val =
+            cg.builder->CreateLoad(struct_type, struct_ptr);
+        cg.builder->CreateRet(struct_val);
 
         return struct_val;
     };
 }
 
-auto CodeGen(Xi_ArrayIndex index) -> codegen_result_t
+auto CodeGen(const Xi_ArrayIndex &index, CodeGenContext &cg) -> codegen_result_t
 {
     // generate code for array index
-    auto array_pointer = namedValues.find(index.array_var_name);
-    if (array_pointer == namedValues.end())
+    const auto *array = cg.named_values.find(index.array_var_name);
+    if (array == nullptr)
     {
         return tl::unexpected(ErrorCodeGen(
             ErrorCodeGen::UnknownVariable,
@@ -303,101 +1243,130 @@ auto CodeGen(Xi_ArrayIndex index) -> codegen_result_t
         ));
     }
 
-    return CodeGen(index.index) >>=
-           [array_pointer](auto *index_v) -> codegen_result_t
+    return CodeGen(index.index, cg) >>=
+           [array = *array, &index, &cg](auto *index_v) -> codegen_result_t
     {
+        auto *elements = cg.builder->CreateExtractValue(
+            bindingValue(array, index.array_var_name, cg), 0
+        );
         auto *element_type =
-            array_pointer->second->getType()->getNonOpaquePointerElementType();
-        auto *element_ptr = builder->CreateGEP(
-            element_type, array_pointer->second, index_v, "element_ptr"
+            elements->getType()->getNonOpaquePointerElementType();
+        auto *index_64 = cg.builder->CreateSExtOrTrunc(
+            index_v, llvm::Type::getInt64Ty(*cg.context)
+        );
+        // an index out of the array is undefined, as for any other access
+        // past an allocation
+        auto *element_ptr = cg.builder->CreateInBoundsGEP(
+            element_type, elements, index_64, "element_ptr"
         );
-        return builder->CreateLoad(element_type, element_ptr, "load");
+        auto *element = tagged(
+            cg.builder->CreateLoad(element_type, element_ptr, "load"),
+            elementTag(element_type, cg)
+        );
+        dupValue(element, cg);
+        return element;
     };
 }
 
-auto CodeGen(Xi_If_stmt if_stmt) -> codegen_result_t
+auto CodeGen(const Xi_If_stmt &if_stmt, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(if_stmt.cond) >>=
-           [if_stmt](llvm::Value *cond) -> codegen_result_t
+    return CodeGen(if_stmt.cond, cg) >>=
+           [&if_stmt, &cg](llvm::Value *cond) -> codegen_result_t
     {
-        auto *function = builder->GetInsertBlock()->getParent();
-        auto *then_bb  = llvm::BasicBlock::Create(*context, "then", function);
-        auto *else_bb  = llvm::BasicBlock::Create(*context, "else", function);
-        auto *after_bb = llvm::BasicBlock::Create(*context, "after", function);
-        builder->CreateCondBr(cond, then_bb, else_bb);
-        builder->SetInsertPoint(then_bb);
-        return flatmap(
+        auto *function = cg.builder->GetInsertBlock()->getParent();
+        auto *then_bb =
+            llvm::BasicBlock::Create(*cg.context, "then", function);
+        auto *else_bb =
+            llvm::BasicBlock::Create(*cg.context, "else", function);
+        auto *after_bb =
+            llvm::BasicBlock::Create(*cg.context, "after", function);
+        cg.builder->CreateCondBr(cond, then_bb, else_bb);
+        cg.builder->SetInsertPoint(then_bb);
+        return traverse(
                    if_stmt.then,
-                   [](auto x)
+                   [&cg](const auto &x)
                    {
-                       return CodeGen(x);
+                       return CodeGen(x, cg);
                    }
                ) >>=
-               [after_bb, else_bb, function, if_stmt](auto) -> codegen_result_t
+               [after_bb, else_bb, function, &if_stmt, &cg](auto)
+                   -> codegen_result_t
         {
-            builder->CreateBr(after_bb);
-            builder->SetInsertPoint(else_bb);
-            return flatmap(
+            cg.builder->CreateBr(after_bb);
+            cg.builder->SetInsertPoint(else_bb);
+            return traverse(
                        if_stmt.els,
-                       [](auto x)
+                       [&cg](const auto &x)
                        {
-                           return CodeGen(x);
+                           return CodeGen(x, cg);
                        }
-                   ) >>= [after_bb, function](auto) -> codegen_result_t
+                   ) >>= [after_bb, function, &cg](auto) -> codegen_result_t
             {
-                builder->CreateBr(after_bb);
-                builder->SetInsertPoint(after_bb);
-                module->print(llvm::errs(), nullptr);
+                cg.builder->CreateBr(after_bb);
+                cg.builder->SetInsertPoint(after_bb);
+                cg.module->print(llvm::errs(), nullptr);
                 return function;
             };
         };
     };
 }
 
-auto CodeGen(Xi_Assign assign) -> codegen_result_t
+auto CodeGen(const Xi_Assign &assign, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(assign.expr) >>= [assign](llvm::Value *v) -> codegen_result_t
+    return CodeGen(assign.expr, cg) >>=
+           [&assign, &cg](llvm::Value *v) -> codegen_result_t
     {
-        auto *variable = namedValues[assign.name];
-        auto *old_v =
-            builder->CreateLoad(variable->getAllocatedType(), variable, "old");
-        builder->CreateStore(v, variable);
+        const auto *found = cg.named_values.find(assign.name);
+        if (found == nullptr || found->slot == nullptr)
+        {
+            return tl::unexpected(ErrorCodeGen(
+                ErrorCodeGen::UnknownVariable, assign.name.str()
+            ));
+        }
+        // the old value keeps the reference the variable held, for whoever
+        // takes the result
+        auto *variable = found->slot;
+        auto *old_v    = cg.builder->CreateLoad(
+            variable->getAllocatedType(), variable, "old"
+        );
+        cg.builder->CreateStore(v, variable);
         return old_v;
     };
 }
 
-auto CodeGen(Xi_If if_expr) -> codegen_result_t
+auto CodeGen(const Xi_If &if_expr, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(if_expr.cond) >>=
-           [=](llvm::Value *cond_code) -> codegen_result_t
+    return CodeGen(if_expr.cond, cg) >>=
+           [&if_expr, &cg](llvm::Value *cond_code) -> codegen_result_t
     {
-        auto *function = builder->GetInsertBlock()->getParent();
-        auto *then_bb  = llvm::BasicBlock::Create(*context, "then", function);
-        auto *else_bb  = llvm::BasicBlock::Create(*context, "else");
-        builder->CreateCondBr(cond_code, then_bb, else_bb);
-
-        builder->SetInsertPoint(then_bb);
-        return CodeGen(if_expr.then) >>=
+        auto *function = cg.builder->GetInsertBlock()->getParent();
+        auto *then_bb =
+            llvm::BasicBlock::Create(*cg.context, "then", function);
+        auto *else_bb = llvm::BasicBlock::Create(*cg.context, "else");
+        cg.builder->CreateCondBr(cond_code, then_bb, else_bb);
+
+        cg.builder->SetInsertPoint(then_bb);
+        return CodeGen(if_expr.then, cg) >>=
                [&](llvm::Value *then_code) -> codegen_result_t
         {
-            auto *merge_bb = llvm::BasicBlock::Create(*context, "ifcont");
-            builder->CreateBr(merge_bb);
-            then_bb = builder->GetInsertBlock();
+            auto *merge_bb = llvm::BasicBlock::Create(*cg.context, "ifcont");
+            cg.builder->CreateBr(merge_bb);
+            then_bb = cg.builder->GetInsertBlock();
 
             function->getBasicBlockList().push_back(else_bb);
-            builder->SetInsertPoint(else_bb);
+            cg.builder->SetInsertPoint(else_bb);
 
-            return CodeGen(if_expr.els) >>=
+            return CodeGen(if_expr.els, cg) >>=
                    [&](llvm::Value *else_code) -> codegen_result_t
             {
-                builder->CreateBr(merge_bb);
-                else_bb = builder->GetInsertBlock();
+                cg.builder->CreateBr(merge_bb);
+                else_bb = cg.builder->GetInsertBlock();
 
                 function->getBasicBlockList().push_back(merge_bb);
-                builder->SetInsertPoint(merge_bb);
+                cg.builder->SetInsertPoint(merge_bb);
 
                 auto *phi =
-                    builder->CreatePHI(then_code->getType(), 2, "iftmp");
+                    cg.builder->CreatePHI(then_code->getType(), 2, "iftmp");
                 phi->addIncoming(then_code, then_bb);
                 phi->addIncoming(else_code, else_bb);
                 return phi;
@@ -406,73 +1375,230 @@ auto CodeGen(Xi_If if_expr) -> codegen_result_t
     };
 }
 
-auto CodeGen(Xi_Iden iden) -> codegen_result_t
+auto CodeGen(const Xi_Iden &iden, CodeGenContext &cg) -> codegen_result_t
 {
-    auto *value = namedValues[iden.name];
-    if (value == nullptr)
+    const auto *binding = cg.named_values.find(iden.name);
+    if (binding == nullptr)
     {
         return tl::unexpected(
-            ErrorCodeGen(ErrorCodeGen::UnknownVariable, iden.name)
+            ErrorCodeGen(ErrorCodeGen::UnknownVariable, iden.name.str())
         );
     }
-    return builder->CreateLoad(
-        value->getAllocatedType(), value, iden.name.c_str()
+    auto *loaded = bindingValue(*binding, iden.name, cg);
+    // the last use of a value takes over the function's reference to it
+    if (cg.last_uses.contains(&iden))
+    {
+        cg.moved_values.push_back(iden.name);
+        return loaded;
+    }
+    dupValue(loaded, cg);
+    return loaded;
+}
+
+// generate expr only to read part of it: a named value is read where it is,
+// any other is dropped once read takes what it needs
+template <typename Read>
+auto codeGenRead(const Xi_Expr &expr, Read read, CodeGenContext &cg)
+    -> codegen_result_t
+{
+    if (const auto *iden = std::get_if<recursive_wrapper<Xi_Iden>>(&expr))
+    {
+        const auto *binding = cg.named_values.find(iden->get().name);
+        if (binding != nullptr)
+        {
+            return read(bindingValue(*binding, iden->get().name, cg));
+        }
+    }
+    return CodeGen(expr, cg) >>=
+           [&read, &cg](llvm::Value *value) -> codegen_result_t
+    {
+        auto *part = read(value);
+        dropValue(value, cg);
+        return part;
+    };
+}
+
+// where expr is stored, if it is a name kept in a slot or a member of one;
+// null otherwise
+auto storedAt(const Xi_Expr &expr, CodeGenContext &cg) -> llvm::Value *
+{
+    if (const auto *iden = std::get_if<recursive_wrapper<Xi_Iden>>(&expr))
+    {
+        const auto *binding = cg.named_values.find(iden->get().name);
+        return binding != nullptr ? binding->slot : nullptr;
+    }
+    const auto *bop = std::get_if<recursive_wrapper<Xi_Binop>>(&expr);
+    if (bop == nullptr || bop->get().op != Xi_Op::Dot)
+    {
+        return nullptr;
+    }
+    auto *set = storedAt(bop->get().lhs, cg);
+    if (set == nullptr)
+    {
+        return nullptr;
+    }
+    return cg.builder->CreateStructGEP(
+        slotType(set),
+        set,
+        static_cast<unsigned int>(bop->get().index),
+        "memberptr"
     );
 }
 
-auto codeGenDot(Xi_Binop bop) -> codegen_result_t
+// a member of a named value is loaded on its own, without the rest of it
+auto codeGenDot(const Xi_Binop &bop, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(bop.lhs) >>= [bop](auto struct_pointer) -> codegen_result_t
+    if (auto *set = storedAt(bop.lhs, cg))
     {
-        auto *v = builder->CreateExtractValue(
-            struct_pointer, static_cast<unsigned int>(bop.index), "membertmp"
+        auto *member_ptr = cg.builder->CreateStructGEP(
+            slotType(set),
+            set,
+            static_cast<unsigned int>(bop.index),
+            "memberptr"
         );
-        return v;
+        auto *member = cg.builder->CreateLoad(
+            slotType(member_ptr), member_ptr, "membertmp"
+        );
+        dupValue(member, cg);
+        return member;
+    }
+    return codeGenRead(
+        bop.lhs,
+        [&bop, &cg](llvm::Value *struct_value)
+        {
+            auto *member = cg.builder->CreateExtractValue(
+                struct_value, static_cast<unsigned int>(bop.index), "membertmp"
+            );
+            dupValue(member, cg);
+            return member;
+        },
+        cg
+    );
+}
+
+// lhs op rhs for two reals; a comparison with NaN is false, but for !=
+auto codeGenRealBinop(
+    Xi_Op op, llvm::Value *lhs, llvm::Value *rhs, CodeGenContext &cg
+) -> codegen_result_t
+{
+    switch (op)
+    {
+    case Xi_Op::Add:
+        return cg.builder->CreateFAdd(lhs, rhs, "addtmp");
+    case Xi_Op::Sub:
+        return cg.builder->CreateFSub(lhs, rhs, "subtmp");
+    case Xi_Op::Mul:
+        return cg.builder->CreateFMul(lhs, rhs, "multmp");
+    case Xi_Op::Div:
+        return cg.builder->CreateFDiv(lhs, rhs, "divtmp");
+    case Xi_Op::Lt:
+        return cg.builder->CreateFCmpOLT(lhs, rhs, "cmptmp");
+    case Xi_Op::Gt:
+        return cg.builder->CreateFCmpOGT(lhs, rhs, "cmptmp");
+    case Xi_Op::Eq:
+        return cg.builder->CreateFCmpOEQ(lhs, rhs, "cmptmp");
+    case Xi_Op::Neq:
+        return cg.builder->CreateFCmpUNE(lhs, rhs, "cmptmp");
+    case Xi_Op::Leq:
+        return cg.builder->CreateFCmpOLE(lhs, rhs, "cmptmp");
+    case Xi_Op::Geq:
+        return cg.builder->CreateFCmpOGE(lhs, rhs, "cmptmp");
+    default:
+        return tl::unexpected(ErrorCodeGen(
+            ErrorCodeGen::UnknownOperator, magic_enum::enum_name(op)
+        ));
+    }
+}
+
+// lhs && rhs or lhs || rhs, where rhs runs only when lhs does not decide the
+// value
+auto codeGenShortCircuit(const Xi_Binop &bop, CodeGenContext &cg)
+    -> codegen_result_t
+{
+    return CodeGen(bop.lhs, cg) >>=
+           [&bop, &cg](llvm::Value *lhs) -> codegen_result_t
+    {
+        auto *function = cg.builder->GetInsertBlock()->getParent();
+        auto *lhs_bb   = cg.builder->GetInsertBlock();
+        auto *rhs_bb   = llvm::BasicBlock::Create(*cg.context, "rhs", function);
+        auto *merge_bb = llvm::BasicBlock::Create(*cg.context, "logiccont");
+        auto  is_and   = bop.op == Xi_Op::And;
+        if (is_and)
+        {
+            cg.builder->CreateCondBr(lhs, rhs_bb, merge_bb);
+        }
+        else
+        {
+            cg.builder->CreateCondBr(lhs, merge_bb, rhs_bb);
+        }
+
+        cg.builder->SetInsertPoint(rhs_bb);
+        return CodeGen(bop.rhs, cg) >>=
+               [&cg, function, lhs_bb, merge_bb, is_and](llvm::Value *rhs
+               ) -> codegen_result_t
+        {
+            cg.builder->CreateBr(merge_bb);
+            auto *rhs_end = cg.builder->GetInsertBlock();
+
+            function->getBasicBlockList().push_back(merge_bb);
+            cg.builder->SetInsertPoint(merge_bb);
+            auto *phi = cg.builder->CreatePHI(rhs->getType(), 2, "logictmp");
+            phi->addIncoming(
+                llvm::ConstantInt::get(rhs->getType(), is_and ? 0 : 1), lhs_bb
+            );
+            phi->addIncoming(rhs, rhs_end);
+            return phi;
+        };
     };
 }
 
-auto CodeGen(Xi_Binop bop) -> codegen_result_t
+auto CodeGen(const Xi_Binop &bop, CodeGenContext &cg) -> codegen_result_t
 {
     if (bop.op == Xi_Op::Dot)
     {
-        return codeGenDot(bop);
+        return codeGenDot(bop, cg);
     }
-    return CodeGen(bop.lhs) >>= [bop](llvm::Value *lhs)
+    if (bop.op == Xi_Op::And || bop.op == Xi_Op::Or)
     {
-        return CodeGen(bop.rhs) >>=
-               [lhs, bop](llvm::Value *rhs) -> codegen_result_t
+        return codeGenShortCircuit(bop, cg);
+    }
+    return CodeGen(bop.lhs, cg) >>= [&bop, &cg](llvm::Value *lhs)
+    {
+        return CodeGen(bop.rhs, cg) >>=
+               [lhs, &bop, &cg](llvm::Value *rhs) -> codegen_result_t
         {
+            // type assignment has made both operands the same type
+            if (lhs->getType()->isFloatingPointTy())
+            {
+                return codeGenRealBinop(bop.op, lhs, rhs, cg);
+            }
             switch (bop.op)
             {
             case Xi_Op::Add:
-                return builder->CreateAdd(lhs, rhs, "addtmp");
+                return cg.builder->CreateAdd(lhs, rhs, "addtmp");
             case Xi_Op::Sub:
-                return builder->CreateSub(lhs, rhs, "subtmp");
+                return cg.builder->CreateSub(lhs, rhs, "subtmp");
             case Xi_Op::Mul:
-                return builder->CreateMul(lhs, rhs, "multmp");
+                return cg.builder->CreateMul(lhs, rhs, "multmp");
             case Xi_Op::Div:
-                return builder->CreateSDiv(lhs, rhs, "divtmp");
+                return cg.builder->CreateSDiv(lhs, rhs, "divtmp");
             // TODO(ding.wang): check type
             case Xi_Op::Lt:
-                return builder->CreateICmpSLT(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpSLT(lhs, rhs, "cmptmp");
             case Xi_Op::Gt:
-                return builder->CreateICmpSGT(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpSGT(lhs, rhs, "cmptmp");
             case Xi_Op::Eq:
-                return builder->CreateICmpEQ(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpEQ(lhs, rhs, "cmptmp");
             case Xi_Op::Neq:
-                return builder->CreateICmpNE(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpNE(lhs, rhs, "cmptmp");
             case Xi_Op::Leq:
-                return builder->CreateICmpSLE(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpSLE(lhs, rhs, "cmptmp");
             case Xi_Op::Geq:
-                return builder->CreateICmpSGE(lhs, rhs, "cmptmp");
+                return cg.builder->CreateICmpSGE(lhs, rhs, "cmptmp");
             case Xi_Op::Mod:
-                return builder->CreateSRem(lhs, rhs, "modtmp");
-            case Xi_Op::And:
-                return builder->CreateAnd(lhs, rhs, "andtmp");
-            case Xi_Op::Or:
-                return builder->CreateOr(lhs, rhs, "ortmp");
+                return cg.builder->CreateSRem(lhs, rhs, "modtmp");
             case Xi_Op::Xor:
-                return builder->CreateXor(lhs, rhs, "xortmp");
+                return cg.builder->CreateXor(lhs, rhs, "xortmp");
             default:
                 return tl::unexpected(ErrorCodeGen(
                     ErrorCodeGen::UnknownOperator, magic_enum::enum_name(bop.op)
@@ -482,18 +1608,23 @@ auto CodeGen(Xi_Binop bop) -> codegen_result_t
     };
 }
 
-auto CodeGen(Xi_Unop uop) -> codegen_result_t
+auto CodeGen(const Xi_Unop &uop, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(uop.expr) >>= [uop](auto expr_code) -> codegen_result_t
+    return CodeGen(uop.expr, cg) >>=
+           [&uop, &cg](auto expr_code) -> codegen_result_t
     {
         switch (uop.op)
         {
         case Xi_Op::Add:
             return expr_code;
         case Xi_Op::Sub:
-            return builder->CreateNeg(expr_code);
+            if (expr_code->getType()->isFloatingPointTy())
+            {
+                return cg.builder->CreateFNeg(expr_code);
+            }
+            return cg.builder->CreateNeg(expr_code);
         case Xi_Op::Not:
-            return builder->CreateNot(expr_code);
+            return cg.builder->CreateNot(expr_code);
         default:
             return tl::unexpected(ErrorCodeGen(
                 ErrorCodeGen::UnknownOperator, magic_enum::enum_name(uop.op)
@@ -502,61 +1633,149 @@ auto CodeGen(Xi_Unop uop) -> codegen_result_t
     };
 }
 
-auto CodeGen(Xi_Call call_expr) -> codegen_result_t
+// call callee with args, marked the way its prototype takes them
+auto createCall(
+    llvm::Function                   *callee,
+    const std::vector<llvm::Value *> &args,
+    CodeGenContext                   &cg
+) -> llvm::CallInst *
 {
-    llvm::Function *calleeF = module->getFunction(call_expr.name);
+    auto *call = cg.builder->CreateCall(
+        callee, args, callee->getReturnType()->isVoidTy() ? "" : "calltmp"
+    );
+    auto params = std::vector<llvm::AttributeSet>{};
+    for (unsigned int i = 0; i < callee->arg_size(); i++)
+    {
+        params.push_back(callee->getAttributes().getParamAttrs(i));
+    }
+    call->setAttributes(llvm::AttributeList::get(
+        *cg.context, llvm::AttributeSet{}, llvm::AttributeSet{}, params
+    ));
+    return call;
+}
 
-    return flatmap(
+// the arguments of call_expr, after result, the address the callee builds
+// its set at if it returns one in memory
+auto codeGenArguments(
+    const Xi_Call &call_expr, llvm::Value *result, CodeGenContext &cg
+) -> ExpectedCodeGen<std::vector<llvm::Value *>>
+{
+    return traverse(
                call_expr.args,
-               [](auto arg)
+               [&cg](const auto &arg)
                {
-                   return CodeGen(arg);
+                   return CodeGen(arg, cg);
                }
-           ) >>= [calleeF, call_expr](std::vector<llvm::Value *> argsV
-                 ) -> codegen_result_t
+           ) >>= [result](std::vector<llvm::Value *> args)
+               -> ExpectedCodeGen<std::vector<llvm::Value *>>
+    {
+        if (result != nullptr)
+        {
+            args.insert(args.begin(), result);
+        }
+        return args;
+    };
+}
+
+// call the function call_expr names; one that returns its set in memory
+// builds it at result
+auto codeGenCall(
+    const Xi_Call &call_expr, llvm::Value *result, CodeGenContext &cg
+) -> codegen_result_t
+{
+    auto *callee = cg.module->getFunction(call_expr.name.str());
+    return codeGenArguments(call_expr, result, cg) >>=
+           [callee, &cg](std::vector<llvm::Value *> args) -> codegen_result_t
     {
-        return builder->CreateCall(calleeF, argsV, "calltmp");
+        return createCall(callee, args, cg);
     };
 }
 
-auto CodeGen(Xi_Lam) -> codegen_result_t
+// the call expr is if it returns a set in memory, which can then be built
+// straight where it is kept; null otherwise
+auto callInMemory(const Xi_Expr &expr, CodeGenContext &cg) -> const Xi_Call *
+{
+    const auto *call = std::get_if<recursive_wrapper<Xi_Call>>(&expr);
+    if (call == nullptr)
+    {
+        return nullptr;
+    }
+    auto *callee = cg.module->getFunction(call->get().name.str());
+    return callee != nullptr && callee->hasStructRetAttr() ? &call->get()
+                                                           : nullptr;
+}
+
+auto CodeGen(const Xi_Call &call_expr, CodeGenContext &cg) -> codegen_result_t
+{
+    llvm::Function *calleeF = cg.module->getFunction(call_expr.name.str());
+    if (calleeF == nullptr && call_expr.name == LenSymbol())
+    {
+        return codeGenRead(
+            call_expr.args.front(),
+            [&cg](llvm::Value *array)
+            {
+                return cg.builder->CreateExtractValue(array, 1, "len");
+            },
+            cg
+        );
+    }
+
+    if (!calleeF->hasStructRetAttr())
+    {
+        return codeGenCall(call_expr, nullptr, cg);
+    }
+    auto *result_type = calleeF->getParamStructRetType(0);
+    auto *result      = CreateEntryBlockAlloca(
+        cg.builder->GetInsertBlock()->getParent(), "result", result_type
+    );
+    return codeGenCall(call_expr, result, cg) >>=
+           [result, result_type, &cg](llvm::Value *) -> codegen_result_t
+    {
+        return cg.builder->CreateLoad(result_type, result, "calltmp");
+    };
+}
+
+auto CodeGen(Xi_Lam, CodeGenContext & /*unused*/) -> codegen_result_t
 {
     return tl::unexpected(ErrorCodeGen(ErrorCodeGen::NotImplemented, "Lambda"));
 }
 
-auto CodeGen(Xi_String s) -> codegen_result_t
+auto CodeGen(const Xi_String &s, CodeGenContext &cg) -> codegen_result_t
 {
-    return builder->CreateGlobalStringPtr(s.value);
+    return cg.builder->CreateGlobalStringPtr(s.value);
 }
 
-auto CodeGen(Xi_Decl decl) -> codegen_result_t
+auto CodeGen(const Xi_Decl &decl, CodeGenContext &cg) -> codegen_result_t
 {
     return std::visit(
-        [decl](auto decl_type_wrapper) -> codegen_result_t
+        [&decl, &cg](const auto &decl_type_wrapper) -> codegen_result_t
         {
             if constexpr (std::same_as<
                               std::decay_t<decltype(decl_type_wrapper)>,
                               recursive_wrapper<type::function>>)
             {
-                auto decl_type = decl_type_wrapper.get();
-                return flatmap(decl_type.param_types, XiTypeToLLVMType) >>=
-                       [decl, decl_type](auto arg_types) -> codegen_result_t
+                const auto &decl_type = decl_type_wrapper.get();
+                auto        to_llvm   = [&cg](const auto &param_type)
                 {
-                    return XiTypeToLLVMType(decl_type.return_type) >>=
-                           [decl, arg_types, decl_type](llvm::Type *return_type
-                           ) mutable -> codegen_result_t
+                    return XiTypeToLLVMType(param_type, cg);
+                };
+                return traverse(decl_type.param_types, to_llvm) >>=
+                       [&decl, &decl_type, &cg](auto arg_types)
+                           -> codegen_result_t
+                {
+                    return XiTypeToLLVMType(decl_type.return_type, cg) >>=
+                           [&decl, &arg_types, &decl_type, &cg](
+                               llvm::Type *return_type
+                           ) -> codegen_result_t
                     {
-                        auto *func_type = llvm::FunctionType::get(
-                            return_type, arg_types, decl_type.is_vararg
-                        );
-
-                        auto *function = llvm::Function::Create(
-                            func_type,
-                            llvm::Function::ExternalLinkage,
-                            static_cast<std::string>(decl.name),
-                            module.get()
+                        auto *function = createFunction(
+                            decl.name.str(),
+                            return_type,
+                            arg_types,
+                            decl_type.is_vararg,
+                            cg
                         );
-
+                        markEffects(*function, decl.name, cg);
                         return function;
                     };
                 };
@@ -573,48 +1792,145 @@ auto CodeGen(Xi_Decl decl) -> codegen_result_t
     );
 }
 
-auto CodeGen(std::monostate) -> codegen_result_t
+auto CodeGen(std::monostate, CodeGenContext & /*unused*/) -> codegen_result_t
 {
     return tl::unexpected(
         ErrorCodeGen(ErrorCodeGen::NotImplemented, "monostate")
     );
 }
 
-auto CodeGen(Xi_Expr expr) -> codegen_result_t
+auto CodeGen(const Xi_Expr &expr, CodeGenContext &cg) -> codegen_result_t
 {
-    return std::visit(
-        [](auto expr_)
+    return Visit(
+        [&cg](const auto &expr_)
         {
-            return CodeGen(expr_);
+            return CodeGen(expr_, cg);
         },
         expr
     );
 }
 
-auto CodeGen(Xi_Return ret) -> codegen_result_t
+// return value from the function being generated, through the address of its
+// result if that is in memory
+void createReturn(llvm::Value *value, CodeGenContext &cg)
+{
+    auto *function = cg.builder->GetInsertBlock()->getParent();
+    if (function->hasStructRetAttr())
+    {
+        cg.builder->CreateStore(value, function->getArg(0));
+        cg.builder->CreateRetVoid();
+        return;
+    }
+    cg.builder->CreateRet(value);
+}
+
+// the value returned holds references of its own, so every slot the
+// statement function owns is dropped on the way out
+auto CodeGen(const Xi_Return &ret, CodeGenContext &cg) -> codegen_result_t
 {
-    return CodeGen(ret.expr) >>= [](llvm::Value *v) -> codegen_result_t
+    return CodeGen(ret.expr, cg) >>= [&cg](llvm::Value *v) -> codegen_result_t
     {
-        builder->CreateRet(v);
+        for (auto *slot : cg.owned_slots)
+        {
+            dropValue(
+                cg.builder->CreateLoad(slot->getAllocatedType(), slot), cg
+            );
+        }
+        createReturn(v, cg);
         return v;
     };
 }
 
-auto CodeGen(Xi_Var var) -> codegen_result_t
+// An array no one owns, of array_type: its elements are just past a count of
+// 0, so taking and giving up references to it do nothing.
+auto emptyArray(llvm::StructType *array_type, CodeGenContext &cg)
+    -> llvm::Constant *
+{
+    auto *int64type = llvm::Type::getInt64Ty(*cg.context);
+    auto *count     = cg.module->getNamedGlobal("xi.empty");
+    if (count == nullptr)
+    {
+        count = new llvm::GlobalVariable(
+            *cg.module,
+            int64type,
+            false,
+            llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantInt::get(int64type, 0),
+            "xi.empty"
+        );
+    }
+    auto *elements = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        int64type, count, llvm::ConstantInt::get(int64type, 1)
+    );
+    return llvm::ConstantStruct::get(
+        array_type,
+        {
+            llvm::ConstantExpr::getBitCast(
+                elements, array_type->getElementType(0)
+            ),
+            llvm::ConstantInt::get(int64type, 0),
+        }
+    );
+}
+
+// a value of type holding no references, to drop harmlessly
+auto emptyValue(llvm::Type *type, CodeGenContext &cg) -> llvm::Constant *
+{
+    auto *struct_type = llvm::dyn_cast<llvm::StructType>(type);
+    if (struct_type == nullptr || !isCounted(type))
+    {
+        return llvm::Constant::getNullValue(type);
+    }
+    if (struct_type->isLiteral())
+    {
+        return emptyArray(struct_type, cg);
+    }
+    auto members = std::vector<llvm::Constant *>{};
+    for (auto *member_type : struct_type->elements())
+    {
+        members.push_back(emptyValue(member_type, cg));
+    }
+    return llvm::ConstantStruct::get(struct_type, members);
+}
+
+// A var holding arrays lives in a slot of the entry block that starts out
+// empty, so a var declared in a loop drops the value the last pass left.
+auto CodeGen(const Xi_Var &var, CodeGenContext &cg) -> codegen_result_t
 {
-    return XiTypeToLLVMType(var.type) >>=
-           [var](llvm::Type *llvm_type) -> codegen_result_t
+    return XiTypeToLLVMType(var.type, cg) >>=
+           [&var, &cg](llvm::Type *llvm_type) -> codegen_result_t
     {
+        auto counted = isCounted(llvm_type);
         auto alloca =
-            builder->CreateAlloca(llvm_type, 0, nullptr, var.name.c_str());
+            counted ? CreateEntryBlockAlloca(
+                          cg.builder->GetInsertBlock()->getParent(),
+                          var.name.str(),
+                          llvm_type
+                      )
+                    : cg.builder->CreateAlloca(
+                          llvm_type, 0, nullptr, var.name.c_str()
+                      );
+        if (counted)
+        {
+            auto entry = llvm::IRBuilder<>(
+                alloca->getParent(), std::next(alloca->getIterator())
+            );
+            entry.CreateStore(emptyValue(llvm_type, cg), alloca);
+            cg.owned_slots.push_back(alloca);
+        }
 
-        namedValues[var.name] = alloca;
+        cg.named_values.insert_or_assign(var.name, Binding{.slot = alloca});
         if (var.value != std::monostate{})
         {
-            return CodeGen(var.value) >>=
-                   [var, &alloca](llvm::Value *init) -> codegen_result_t
+            return CodeGen(var.value, cg) >>=
+                   [&alloca, counted, llvm_type, &cg](llvm::Value *init)
+                       -> codegen_result_t
             {
-                builder->CreateStore(init, alloca);
+                if (counted)
+                {
+                    dropValue(cg.builder->CreateLoad(llvm_type, alloca), cg);
+                }
+                cg.builder->CreateStore(init, alloca);
                 return alloca;
             };
         }
@@ -622,107 +1938,475 @@ auto CodeGen(Xi_Var var) -> codegen_result_t
     };
 }
 
-auto codeGenExprFunc(Xi_Func xi_func, llvm::Function *llvm_func)
-    -> codegen_result_t
+// end a path through the function: drop the values it owns and has not
+// handed on
+void dropOwned(CodeGenContext &cg)
+{
+    for (auto name : cg.owned_values)
+    {
+        if (std::ranges::find(cg.moved_values, name) == cg.moved_values.end())
+        {
+            dropValue(
+                bindingValue(*cg.named_values.find(name), name, cg), cg
+            );
+        }
+    }
+    cg.last_uses.clear();
+    cg.moved_values.clear();
+}
+
+// an array of array_type the function owns and, at the end of a path through
+// it, no longer reads, taken over from it; null if there is none
+auto deadArray(llvm::Type *array_type, CodeGenContext &cg) -> llvm::Value *
+{
+    if (cg.alloc_mode == AllocMode::Arena)
+    {
+        return nullptr;
+    }
+    for (auto name : cg.owned_values)
+    {
+        const auto &binding = *cg.named_values.find(name);
+        if (bindingType(binding) == array_type &&
+            std::ranges::find(cg.moved_values, name) == cg.moved_values.end())
+        {
+            cg.moved_values.push_back(name);
+            return bindingValue(binding, name, cg);
+        }
+    }
+    return nullptr;
+}
+
+// Where a self tail call of the function being generated jumps: the block
+// that takes its arguments, with the bindings of its parameters, each a phi
+// in the header or a slot. A function without self tail calls has no header.
+struct TailLoop
+{
+    Symbol               name;
+    llvm::BasicBlock    *header = nullptr;
+    std::vector<Binding> params;
+};
+
+// A tail call may drop the caller's frame only if no argument points into it,
+// as a set in the caller's memory or an array with its elements in the frame
+// does. An array is looked through to the pointer it was made with; escape
+// analysis already keeps frame arrays out of tail calls, this only backs it.
+inline auto pointsIntoFrame(llvm::Value *value) -> bool
+{
+    if (value->getType()->isPointerTy())
+    {
+        return llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(value));
+    }
+    auto *struct_type = llvm::dyn_cast<llvm::StructType>(value->getType());
+    if (struct_type == nullptr)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < struct_type->getNumElements(); i++)
+    {
+        auto *member = llvm::FindInsertedValue(value, {i});
+        if (member != nullptr && pointsIntoFrame(member))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// call callee in tail position and return its value; with the caller's
+// prototype the call is musttail, so the backend reuses the caller's frame
+// for it whatever the optimization level
+auto codeGenTailCall(
+    llvm::Function                  *callee,
+    const std::vector<llvm::Value *> &args,
+    CodeGenContext                   &cg
+) -> ExpectedCodeGen<std::monostate>
+{
+    auto *caller = cg.builder->GetInsertBlock()->getParent();
+    auto *call   = createCall(callee, args, cg);
+    if (std::ranges::none_of(args, pointsIntoFrame))
+    {
+        auto same_prototype =
+            callee->getFunctionType() == caller->getFunctionType() &&
+            !caller->isVarArg() &&
+            callee->getCallingConv() == caller->getCallingConv();
+        call->setTailCallKind(
+            same_prototype ? llvm::CallInst::TCK_MustTail
+                           : llvm::CallInst::TCK_Tail
+        );
+    }
+    if (callee->getReturnType()->isVoidTy())
+    {
+        cg.builder->CreateRetVoid();
+        return std::monostate{};
+    }
+    cg.builder->CreateRet(call);
+    return std::monostate{};
+}
+
+// generate expr as the value of the function: every path through it ends in
+// a ret, or for a self tail call in a jump back to loop.header
+auto codeGenTail(const Xi_Expr &expr, const TailLoop &loop, CodeGenContext &cg)
+    -> ExpectedCodeGen<std::monostate>
+{
+    if (const auto *if_wrapper = std::get_if<recursive_wrapper<Xi_If>>(&expr))
+    {
+        const auto &if_expr = if_wrapper->get();
+        return CodeGen(if_expr.cond, cg) >>=
+               [&if_expr, &loop, &cg](llvm::Value *cond_code)
+        {
+            auto *function = cg.builder->GetInsertBlock()->getParent();
+            auto *then_bb =
+                llvm::BasicBlock::Create(*cg.context, "then", function);
+            auto *else_bb =
+                llvm::BasicBlock::Create(*cg.context, "else", function);
+            cg.builder->CreateCondBr(cond_code, then_bb, else_bb);
+
+            cg.builder->SetInsertPoint(then_bb);
+            return codeGenTail(if_expr.then, loop, cg) >>=
+                   [&if_expr, &loop, &cg, else_bb](auto)
+            {
+                cg.builder->SetInsertPoint(else_bb);
+                return codeGenTail(if_expr.els, loop, cg);
+            };
+        };
+    }
+    if (const auto *call_wrapper =
+            std::get_if<recursive_wrapper<Xi_Call>>(&expr);
+        call_wrapper != nullptr &&
+        cg.module->getFunction(call_wrapper->get().name.str()) != nullptr)
+    {
+        const auto &call   = call_wrapper->get();
+        auto       *callee = cg.module->getFunction(call.name.str());
+        auto       *caller = cg.builder->GetInsertBlock()->getParent();
+        auto        self   = loop.header != nullptr && call.name == loop.name;
+        cg.last_uses       = LastUses(expr);
+        // a set another function returns in memory it builds straight at the
+        // address this one was given for its own
+        auto *result =
+            !self && callee->hasStructRetAttr() ? caller->getArg(0) : nullptr;
+        return codeGenArguments(call, result, cg) >>=
+               [callee, self, &loop, &cg](std::vector<llvm::Value *> args)
+                   -> ExpectedCodeGen<std::monostate>
+        {
+            // the frame is done with before the call starts
+            dropOwned(cg);
+            if (!self)
+            {
+                return codeGenTailCall(callee, args, cg);
+            }
+            // every argument is computed before any parameter changes
+            for (const auto &[arg, param] :
+                 ranges::views::zip(args, loop.params))
+            {
+                if (param.slot != nullptr)
+                {
+                    cg.builder->CreateStore(arg, param.slot);
+                }
+                else
+                {
+                    llvm::cast<llvm::PHINode>(param.value)
+                        ->addIncoming(arg, cg.builder->GetInsertBlock());
+                }
+            }
+            cg.builder->CreateBr(loop.header);
+            return std::monostate{};
+        };
+    }
+    cg.last_uses = LastUses(expr);
+    auto value   = ExpectedCodeGen<llvm::Value *>{};
+    if (const auto *array = std::get_if<recursive_wrapper<Xi_Array>>(&expr))
+    {
+        // a new array can take the memory of one the function is done with
+        value = codeGenArray(
+            array->get(),
+            [&cg](llvm::Type *element_type, uint64_t length)
+            {
+                auto *dead = deadArray(arrayType(element_type, cg), cg);
+                return dead != nullptr
+                           ? reuseArray(dead, length, cg)
+                           : allocArray(
+                                 element_type,
+                                 llvm::ConstantInt::get(
+                                     llvm::Type::getInt64Ty(*cg.context),
+                                     length
+                                 ),
+                                 cg
+                             );
+            },
+            cg
+        );
+    }
+    else
+    {
+        value = CodeGen(expr, cg);
+    }
+    return value >>=
+           [&cg](llvm::Value *result) -> ExpectedCodeGen<std::monostate>
+    {
+        dropOwned(cg);
+        createReturn(result, cg);
+        return std::monostate{};
+    };
+}
+
+// whether expr assigns to a name
+auto assigns(const Xi_Expr &expr) -> bool
+{
+    auto through = [](const Xi_Expr &child)
+    {
+        return assigns(child);
+    };
+    return Visit(
+        [&through]<typename T>(const T &node) -> bool
+        {
+            if constexpr (std::same_as<T, Xi_Assign>)
+            {
+                return true;
+            }
+            else if constexpr (std::same_as<T, Xi_If>)
+            {
+                return through(node.cond) || through(node.then) ||
+                       through(node.els);
+            }
+            else if constexpr (std::same_as<T, Xi_Binop>)
+            {
+                return through(node.lhs) || through(node.rhs);
+            }
+            else if constexpr (std::same_as<T, Xi_Unop>)
+            {
+                return through(node.expr);
+            }
+            else if constexpr (std::same_as<T, Xi_ArrayIndex>)
+            {
+                return through(node.index);
+            }
+            else if constexpr (std::same_as<T, Xi_Call>)
+            {
+                return std::ranges::any_of(node.args, through);
+            }
+            else if constexpr (std::same_as<T, Xi_Array>)
+            {
+                return std::ranges::any_of(node.elements, through);
+            }
+            return false;
+        },
+        expr
+    );
+}
+
+// whether the names of func can change, so they have to live in slots: a
+// statement function's, or those of an expression that assigns to one
+auto namesInSlots(const Xi_Func &func) -> bool
 {
-    return flatmap(
+    return func.expr == std::monostate{} || assigns(func.expr) ||
+           std::ranges::any_of(
+               func.let_idens,
+               [](const Xi_Iden &let)
+               {
+                   return assigns(let.expr);
+               }
+           );
+}
+
+// The body is generated in tail position, after the let bindings. With a
+// self tail call the bindings and body form a loop the call jumps back into,
+// so tail recursion runs in a single frame; parameters bound to their values
+// are then bound to phis of the arguments instead.
+auto codeGenExprFunc(
+    const Xi_Func              &xi_func,
+    llvm::Function             *llvm_func,
+    const std::vector<Binding> &params,
+    CodeGenContext             &cg
+) -> codegen_result_t
+{
+    auto loop = TailLoop{
+        .name   = xi_func.name,
+        .header = nullptr,
+        .params = params,
+    };
+    if (std::ranges::any_of(
+            TailCalls(xi_func),
+            [&xi_func](const Xi_Call *call)
+            {
+                return call->name == xi_func.name;
+            }
+        ))
+    {
+        auto *entry = cg.builder->GetInsertBlock();
+        loop.header =
+            llvm::BasicBlock::Create(*cg.context, "tailrecurse", llvm_func);
+        cg.builder->CreateBr(loop.header);
+        cg.builder->SetInsertPoint(loop.header);
+        for (auto &&[param, name] :
+             ranges::views::zip(loop.params, xi_func.params))
+        {
+            if (param.slot != nullptr)
+            {
+                continue;
+            }
+            auto *phi = cg.builder->CreatePHI(
+                param.value->getType(), 2, name.str()
+            );
+            phi->addIncoming(param.value, entry);
+            param.value = phi;
+            cg.named_values.insert_or_assign(name, param);
+        }
+    }
+
+    // a let bound to a call returning a set in memory has the call build it
+    // in the let's slot, which stands for its value until all are bound
+    return traverse(
                xi_func.let_idens,
-               [](Xi_Iden iden)
+               [llvm_func, &cg](const Xi_Iden &iden) -> codegen_result_t
                {
-                   return CodeGen(iden.expr);
+                   const auto *call = callInMemory(iden.expr, cg);
+                   if (call == nullptr)
+                   {
+                       return CodeGen(iden.expr, cg);
+                   }
+                   auto *slot = CreateEntryBlockAlloca(
+                       llvm_func,
+                       iden.name.str(),
+                       cg.module->getFunction(call->name.str())
+                           ->getParamStructRetType(0)
+                   );
+                   return codeGenCall(*call, slot, cg) >>=
+                          [slot](llvm::Value *) -> codegen_result_t
+                   {
+                       return slot;
+                   };
                }
-           ) >>= [&llvm_func, xi_func](auto idens_code) -> codegen_result_t
+           ) >>= [&llvm_func, &xi_func, &loop, &cg](auto idens_code)
+               -> codegen_result_t
     {
+        auto in_slots = namesInSlots(xi_func);
         for (const auto &[iden_code, let_var] :
              ranges::views::zip(idens_code, xi_func.let_idens))
         {
-            llvm::AllocaInst *Alloca = CreateEntryBlockAlloca(
-                llvm_func, std::string(let_var.name), iden_code->getType()
-            );
-
-            // Store the initial value into the alloca.
-            builder->CreateStore(iden_code, Alloca);
-
-            // Add arguments to variable symbol table.
-            namedValues[let_var.name] = Alloca;
+            auto binding = Binding{.value = iden_code};
+            if (callInMemory(let_var.expr, cg) != nullptr)
+            {
+                binding = Binding{
+                    .slot = llvm::cast<llvm::AllocaInst>(iden_code),
+                };
+            }
+            else if (in_slots)
+            {
+                binding = Binding{
+                    .slot = CreateEntryBlockAlloca(
+                        llvm_func, let_var.name.str(), iden_code->getType()
+                    ),
+                };
+                cg.builder->CreateStore(iden_code, binding.slot);
+            }
+            cg.named_values.insert_or_assign(let_var.name, binding);
+            if (isCounted(bindingType(binding)))
+            {
+                cg.owned_values.push_back(let_var.name);
+            }
         }
 
-        auto body = CodeGen(xi_func.expr);
+        auto body = codeGenTail(xi_func.expr, loop, cg);
         if (body)
         {
-            builder->CreateRet(body.value());
             llvm::verifyFunction(*llvm_func);
             // Optimize the function.
             return llvm_func;
         }
 
         llvm_func->eraseFromParent();
-        return body;
+        return tl::unexpected(body.error());
     };
 }
 
-auto codeGenStmtFunc(Xi_Func xi_func, llvm::Function *llvm_func)
-    -> codegen_result_t
+auto codeGenStmtFunc(
+    const Xi_Func &xi_func, llvm::Function *llvm_func, CodeGenContext &cg
+) -> codegen_result_t
 {
-    return flatmap(
+    return traverse(
                xi_func.stmts,
-               [](auto stmt)
+               [&cg](const auto &stmt)
                {
-                   return CodeGen(stmt);
+                   return CodeGen(stmt, cg);
                }
            ) >>=
-           [xi_func, &llvm_func](std::vector<llvm::Value *>) -> codegen_result_t
+           [&llvm_func](std::vector<llvm::Value *>) -> codegen_result_t
     {
         llvm::verifyFunction(*llvm_func);
         return llvm_func;
     };
 }
 
-auto CodeGen(Xi_Func xi_func) -> codegen_result_t
+auto CodeGen(const Xi_Func &xi_func, CodeGenContext &cg) -> codegen_result_t
 {
-    auto *llvm_func =
-        module->getFunction(static_cast<std::string>(xi_func.name));
-
-    auto *bb = llvm::BasicBlock::Create(*context, "entry", llvm_func);
-    builder->SetInsertPoint(bb);
-
-    namedValues.clear();
+    auto *llvm_func = cg.module->getFunction(xi_func.name.str());
+
+    auto *bb = llvm::BasicBlock::Create(*cg.context, "entry", llvm_func);
+    cg.builder->SetInsertPoint(bb);
+
+    cg.named_values.clear();
+    cg.owned_values.clear();
+    cg.owned_slots.clear();
+    cg.last_uses.clear();
+    cg.moved_values.clear();
+    auto in_slots = namesInSlots(xi_func);
+    auto params   = std::vector<Binding>{};
     auto param_it = xi_func.params.begin();
     for (auto &arg : llvm_func->args())
     {
-        arg.setName(*param_it);
+        if (arg.hasStructRetAttr())
+        {
+            arg.setName("result");
+            continue;
+        }
+        auto param = *param_it;
         param_it++;
-        // Create an alloca for this variable.
-        llvm::AllocaInst *Alloca = CreateEntryBlockAlloca(
-            llvm_func, std::string(arg.getName()), arg.getType()
-        );
-
-        // Store the initial value into the alloca.
-        builder->CreateStore(&arg, Alloca);
-
-        // Add arguments to variable symbol table.
-        namedValues[std::string(arg.getName())] = Alloca;
+        arg.setName(param.str());
+        auto binding = Binding{.value = &arg};
+        if (in_slots)
+        {
+            binding = Binding{
+                .slot = CreateEntryBlockAlloca(
+                    llvm_func, param.str(), arg.getType()
+                ),
+            };
+            cg.builder->CreateStore(&arg, binding.slot);
+        }
+        cg.named_values.insert_or_assign(param, binding);
+        params.push_back(binding);
+        // the caller hands its reference to each argument on
+        if (isCounted(arg.getType()))
+        {
+            cg.owned_values.push_back(param);
+            if (xi_func.expr == std::monostate{})
+            {
+                cg.owned_slots.push_back(binding.slot);
+            }
+        }
     }
 
-    if (xi_func.expr != std::monostate{})
+    auto generated = xi_func.expr != std::monostate{}
+                         ? codeGenExprFunc(xi_func, llvm_func, params, cg)
+                         : codeGenStmtFunc(xi_func, llvm_func, cg);
+    return generated >>= [llvm_func, &cg](llvm::Value *) -> codegen_result_t
     {
-        return codeGenExprFunc(xi_func, llvm_func);
-    }
-    return codeGenStmtFunc(xi_func, llvm_func);
+        simplifyFunction(*llvm_func, cg);
+        return llvm_func;
+    };
 }
 
-auto CodeGen(Xi_Comment) -> codegen_result_t
+auto CodeGen(Xi_Comment, CodeGenContext & /*unused*/) -> codegen_result_t
 {
     return {};
 }
 
-auto CodeGen(Xi_Stmts stmts) -> codegen_result_t
+auto CodeGen(const Xi_Stmts &stmts, CodeGenContext &cg) -> codegen_result_t
 {
-    return flatmap(
+    return traverse(
                stmts.stmts,
-               [](auto stmt)
+               [&cg](const auto &stmt)
                {
-                   return CodeGen(stmt);
+                   return CodeGen(stmt, cg);
                }
            ) >>= [](auto) -> codegen_result_t
     {
@@ -730,91 +2414,638 @@ auto CodeGen(Xi_Stmts stmts) -> codegen_result_t
     };
 }
 
-auto CodeGen(Xi_Stmt stmt) -> codegen_result_t
+// the value of an expression statement is not used, so it is dropped
+auto CodeGen(const Xi_Stmt &stmt, CodeGenContext &cg) -> codegen_result_t
 {
-    return std::visit(
-        [](auto stmt_)
+    if (const auto *expr = std::get_if<Xi_Expr>(&stmt))
+    {
+        return CodeGen(*expr, cg) >>=
+               [&cg](llvm::Value *value) -> codegen_result_t
+        {
+            if (value != nullptr)
+            {
+                dropValue(value, cg);
+            }
+            return value;
+        };
+    }
+    return Visit(
+        [&cg](const auto &stmt_)
         {
-            return CodeGen(stmt_);
+            return CodeGen(stmt_, cg);
         },
         stmt
     );
 }
 
-auto CodeGen(Xi_Program program) -> ExpectedCodeGen<std::string>
+// generate program into a new module, which can still be linked with others
+auto codeGenModule(const Xi_Program &program, CodeGenContext &cg)
+    -> ExpectedCodeGen<std::monostate>
 {
-    InitializeModule();
-    return flatmap(
+    InitializeModule(cg);
+    cg.frame_arrays     = NonEscapingArrays(program);
+    cg.function_effects = FunctionEffects(program);
+    return traverse(
                program.stmts,
-               [](auto arg)
+               [&cg](const auto &arg)
                {
-                   return CodeGen(arg);
+                   return CodeGen(arg, cg);
                }
-           ) >>= [](auto) -> ExpectedCodeGen<std::string>
+           ) >>= [](auto) -> ExpectedCodeGen<std::monostate>
     {
-        std::string              output;
-        llvm::raw_string_ostream os(output);
-        module->print(os, nullptr);
-        return output;
+        return std::monostate{};
+    };
+}
+
+auto printModule(CodeGenContext &cg) -> std::string
+{
+    std::string              output;
+    llvm::raw_string_ostream os(output);
+    cg.module->print(os, nullptr);
+    return output;
+}
+
+// Make the functions and constructors program defines internal to the module
+// and fastcc, all but main: nothing else calls them, so LLVM may inline them,
+// change their arguments or drop them once unused. main and the functions
+// program only declares, like printf, keep the C convention. Done to the
+// whole module, as whether a callee is defined in the program can change
+// without its callers' cached IR changing.
+void internalizeFunctions(const Xi_Program &program, CodeGenContext &cg)
+{
+    auto internal      = std::unordered_set<const llvm::Function *>{};
+    auto make_internal = [&internal, &cg](Symbol name)
+    {
+        auto *function = cg.module->getFunction(name.str());
+        if (function == nullptr || function->isDeclaration() ||
+            function->getName() == "main")
+        {
+            return;
+        }
+        function->setLinkage(llvm::GlobalValue::InternalLinkage);
+        function->setCallingConv(llvm::CallingConv::Fast);
+        internal.insert(function);
+    };
+    for (const auto &stmt : program.stmts)
+    {
+        if (const auto *func = std::get_if<recursive_wrapper<Xi_Func>>(&stmt))
+        {
+            make_internal(func->get().name);
+        }
+        else if (const auto *set = std::get_if<Xi_Set>(&stmt))
+        {
+            make_internal(set->name);
+        }
+    }
+    for (auto &function : *cg.module)
+    {
+        for (auto &instruction : llvm::instructions(function))
+        {
+            auto *call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+            if (call == nullptr ||
+                !internal.contains(call->getCalledFunction()))
+            {
+                continue;
+            }
+            call->setCallingConv(llvm::CallingConv::Fast);
+            // a musttail call must keep the caller's convention
+            if (call->isMustTailCall() &&
+                function.getCallingConv() != llvm::CallingConv::Fast)
+            {
+                call->setTailCallKind(llvm::CallInst::TCK_Tail);
+            }
+        }
+    }
+}
+
+auto CodeGen(const Xi_Program &program, CodeGenContext &cg)
+    -> ExpectedCodeGen<std::string>
+{
+    return codeGenModule(program, cg) >>=
+           [&program, &cg](auto) -> ExpectedCodeGen<std::string>
+    {
+        internalizeFunctions(program, cg);
+        return printModule(cg);
+    };
+}
+
+// a program holding what func needs to be generated on its own: every set,
+// the declarations func refers to and func itself
+auto sliceFor(const Xi_Program &program, const Xi_Func &func) -> Xi_Program
+{
+    auto references = References(func);
+    auto byText     = [](Symbol lhs, Symbol rhs)
+    {
+        return lhs.str() < rhs.str();
+    };
+    auto slice = Xi_Program{};
+    for (const auto &stmt : program.stmts)
+    {
+        const auto *decl = std::get_if<Xi_Decl>(&stmt);
+        if (std::holds_alternative<Xi_Set>(stmt) ||
+            (decl != nullptr &&
+             std::binary_search(
+                 references.begin(), references.end(), decl->name, byText
+             )))
+        {
+            slice.stmts.push_back(stmt);
+        }
+    }
+    slice.stmts.emplace_back(func);
+    return slice;
+}
+
+// link the IR of one function, generated on its own, into module; the other
+// definitions it carries (set constructors) are already there
+auto linkFunctionIR(
+    const Xi_Func &func, const std::string &ir, CodeGenContext &cg
+) -> codegen_result_t
+{
+    llvm::SMDiagnostic error;
+    auto               parsed = llvm::parseIR(
+        llvm::MemoryBufferRef(ir, func.name.str()), error, *cg.context
+    );
+    if (parsed == nullptr)
+    {
+        return tl::unexpected(ErrorCodeGen(
+            ErrorCodeGen::Unknown,
+            fmt::format(
+                "cached IR of {}: {}", func.name, error.getMessage().str()
+            )
+        ));
+    }
+    for (auto &other : parsed->functions())
+    {
+        if (other.getName() != func.name.str() && !other.isDeclaration())
+        {
+            other.deleteBody();
+        }
+    }
+    if (llvm::Linker::linkModules(*cg.module, std::move(parsed)))
+    {
+        return tl::unexpected(
+            ErrorCodeGen(ErrorCodeGen::Redefinition, func.name.str())
+        );
+    }
+    return cg.module->getFunction(func.name.str());
+}
+
+// Bumped whenever the IR generated for an unchanged function changes, as when
+// arrays gained their length or started counting references, so IR cached by
+// an older compiler is never linked against a different ABI.
+constexpr uint64_t CodeGenVersion = 2;
+
+// the key of a function's IR in a cache: its fingerprint mixed with the
+// version of the generator and the options of cg that change the IR
+inline auto irCacheKey(Fingerprint fingerprint, const CodeGenContext &cg)
+    -> Fingerprint
+{
+    auto key = MixFingerprint(fingerprint, CodeGenVersion);
+    key      = MixFingerprint(key, static_cast<uint64_t>(cg.alloc_mode));
+    return MixFingerprint(key, uint64_t{cg.fast_math});
+}
+
+// Generate program taking each function's IR from cache while its key from
+// irCacheKey is unchanged. The program must have been type assigned with the same cache.
+// A function that misses is generated on its own from sliceFor and its IR is
+// stored; the module is then the program without functions, with every
+// function's IR linked in.
+auto CodeGen(
+    const Xi_Program &program, FunctionCache &cache, CodeGenContext &cg
+) -> ExpectedCodeGen<std::string>
+{
+    auto functions = std::vector<std::pair<const Xi_Func *, std::string>>{};
+    auto rest      = Xi_Program{};
+    for (const auto &stmt : program.stmts)
+    {
+        const auto *wrapper = std::get_if<recursive_wrapper<Xi_Func>>(&stmt);
+        if (wrapper == nullptr)
+        {
+            rest.stmts.push_back(stmt);
+            continue;
+        }
+        const auto &func = wrapper->get();
+        auto        key  = std::optional<Fingerprint>{};
+        auto        ir   = std::optional<std::string>{};
+        if (auto fingerprint = cache.FingerprintOf(func.name))
+        {
+            key = irCacheKey(*fingerprint, cg);
+            ir  = cache.FindIR(*key);
+        }
+        if (!ir)
+        {
+            auto generated =
+                codeGenModule(sliceFor(program, func), cg) >>= [&cg](auto)
+            {
+                return ExpectedCodeGen<std::string>(printModule(cg));
+            };
+            if (!generated)
+            {
+                return tl::unexpected(generated.error());
+            }
+            if (key)
+            {
+                cache.StoreIR(*key, *generated);
+            }
+            ir = std::move(*generated);
+        }
+        functions.emplace_back(&func, std::move(*ir));
+    }
+
+    return codeGenModule(rest, cg) >>=
+           [&program, &functions, &cg](auto) -> ExpectedCodeGen<std::string>
+    {
+        return traverse(
+                   functions,
+                   [&cg](const auto &function)
+                   {
+                       return linkFunctionIR(
+                           *function.first, function.second, cg
+                       );
+                   }
+               ) >>= [&program, &functions, &cg](auto)
+                   -> ExpectedCodeGen<std::string>
+        {
+            // each function's IR was generated knowing only its own body
+            cg.function_effects = FunctionEffects(program);
+            for (const auto &function : functions)
+            {
+                markEffects(
+                    *cg.module->getFunction(function.first->name.str()),
+                    function.first->name,
+                    cg
+                );
+            }
+            internalizeFunctions(program, cg);
+            return printModule(cg);
+        };
     };
 }
 
-auto GenObj(std::string_view output_file)
+// -O0 to -O3, -Os and -Oz, by the text after -O
+inline auto ParseOptLevel(std::string_view name)
+    -> std::optional<llvm::OptimizationLevel>
 {
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+    static const auto levels =
+        std::array<std::pair<std::string_view, llvm::OptimizationLevel>, 6>{{
+            {"0", llvm::OptimizationLevel::O0},
+            {"1", llvm::OptimizationLevel::O1},
+            {"2", llvm::OptimizationLevel::O2},
+            {"3", llvm::OptimizationLevel::O3},
+            {"s", llvm::OptimizationLevel::Os},
+            {"z", llvm::OptimizationLevel::Oz},
+        }};
+    auto found = ranges::find_if(
+        levels,
+        [name](const auto &level)
+        {
+            return level.first == name;
+        }
+    );
+    if (found == levels.end())
+    {
+        return std::nullopt;
+    }
+    return found->second;
+}
 
-    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    module->setTargetTriple(TargetTriple);
+// register the targets with LLVM, once for every thread compiling
+inline void initializeTargets()
+{
+    static const bool initialized = []
+    {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+        return true;
+    }();
+    static_cast<void>(initialized);
+}
 
-    std::string Error;
-    const auto *Target =
-        llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
+// a new target machine for the host's triple and cpu
+auto createTargetMachine(const TargetCPU &cpu)
+    -> ExpectedCodeGen<std::unique_ptr<llvm::TargetMachine>>
+{
+    initializeTargets();
 
-    // Print an error and exit if we couldn't find the requested target.
+    auto        triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const auto *target = llvm::TargetRegistry::lookupTarget(triple, error);
     // This generally occurs if we've forgotten to initialise the
     // TargetRegistry or we have a bogus target triple.
-    if (Target == nullptr)
+    if (target == nullptr)
+    {
+        return tl::unexpected(ErrorCodeGen(ErrorCodeGen::Unknown, error));
+    }
+    auto subtarget = std::unique_ptr<llvm::MCSubtargetInfo>(
+        target->createMCSubtargetInfo(triple, "", "")
+    );
+    if (!subtarget->isCPUStringValid(cpu.cpu))
+    {
+        return tl::unexpected(ErrorCodeGen(
+            ErrorCodeGen::Unknown,
+            fmt::format("unknown CPU {} for {}", cpu.cpu, triple)
+        ));
+    }
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple,
+        cpu.cpu,
+        cpu.features,
+        llvm::TargetOptions{},
+        llvm::Reloc::Model::DynamicNoPIC
+    ));
+}
+
+// the target machine, created once per SetTargetCPU; module is given its
+// triple and data layout and each of its functions the CPU's attributes, so
+// passes and the backend agree on them
+auto hostTargetMachine(CodeGenContext &cg)
+    -> ExpectedCodeGen<llvm::TargetMachine *>
+{
+    if (cg.target_machine == nullptr)
+    {
+        auto created = createTargetMachine(cg.target_cpu);
+        if (!created)
+        {
+            return tl::unexpected(created.error());
+        }
+        cg.target_machine = std::move(*created);
+    }
+    cg.module->setTargetTriple(cg.target_machine->getTargetTriple().str());
+    cg.module->setDataLayout(cg.target_machine->createDataLayout());
+    for (auto &function : cg.module->functions())
+    {
+        if (!function.isDeclaration())
+        {
+            tuneFunction(function, cg);
+        }
+    }
+    return cg.target_machine.get();
+}
+
+// the backend level matching an -O level; O0 keeps the default level every
+// build used before -O existed
+inline auto codeGenOptLevel(llvm::OptimizationLevel level)
+    -> llvm::CodeGenOpt::Level
+{
+    if (level == llvm::OptimizationLevel::O1)
+    {
+        return llvm::CodeGenOpt::Less;
+    }
+    if (level == llvm::OptimizationLevel::O3)
     {
-        llvm::errs() << Error;
-        return 1;
+        return llvm::CodeGenOpt::Aggressive;
     }
+    return llvm::CodeGenOpt::Default;
+}
 
-    const auto *CPU      = "generic";
-    const auto *Features = "";
+// Run the new pass manager's default pipeline for level over module, tuned
+// for the host, and return the optimized IR. O0 keeps the code as generated.
+// The backend is set to the matching level for GenObj.
+auto Optimize(llvm::OptimizationLevel level, CodeGenContext &cg)
+    -> ExpectedCodeGen<std::string>
+{
+    return hostTargetMachine(cg) >>=
+           [level, &cg](llvm::TargetMachine *machine)
+               -> ExpectedCodeGen<std::string>
+    {
+        // declared in this order so each manager outlives the proxies
+        // registered into it
+        llvm::PassBuilder             pass_builder(machine);
+        llvm::LoopAnalysisManager     lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager    cgam;
+        llvm::ModuleAnalysisManager   mam;
+        pass_builder.registerModuleAnalyses(mam);
+        pass_builder.registerCGSCCAnalyses(cgam);
+        pass_builder.registerFunctionAnalyses(fam);
+        pass_builder.registerLoopAnalyses(lam);
+        pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+        // passes assume valid IR, the backend alone copes with less
+        std::string              problems;
+        llvm::raw_string_ostream problems_os(problems);
+        if (level != llvm::OptimizationLevel::O0 &&
+            llvm::verifyModule(*cg.module, &problems_os))
+        {
+            return tl::unexpected(ErrorCodeGen(ErrorCodeGen::Unknown, problems)
+            );
+        }
+        machine->setOptLevel(codeGenOptLevel(level));
+        auto mpm = level == llvm::OptimizationLevel::O0
+                       ? pass_builder.buildO0DefaultPipeline(level)
+                       : pass_builder.buildPerModuleDefaultPipeline(level);
+        mpm.run(*cg.module, mam);
 
-    llvm::TargetOptions opt;
-    // auto                RM =
-    // llvm::Optional<llvm::Reloc::Model::DynamicNoPIC>();
-    auto *TargetMachine = Target->createTargetMachine(
-        TargetTriple, CPU, Features, opt, llvm::Reloc::Model::DynamicNoPIC
+        std::string              output;
+        llvm::raw_string_ostream os(output);
+        cg.module->print(os, nullptr);
+        return output;
+    };
+}
+
+inline auto jitError(llvm::Error error) -> ErrorCodeGen
+{
+    return ErrorCodeGen(
+        ErrorCodeGen::Unknown, llvm::toString(std::move(error))
     );
+}
+
+// An ORC JIT for the host. Lazy compiles each function through a stub on its
+// first call; otherwise a module is compiled as soon as it is looked into.
+// Host symbols such as printf resolve against this process.
+auto CreateJIT(bool lazy)
+    -> ExpectedCodeGen<std::unique_ptr<llvm::orc::LLJIT>>
+{
+    initializeTargets();
+
+    auto jit = std::unique_ptr<llvm::orc::LLJIT>{};
+    if (lazy)
+    {
+        auto created = llvm::orc::LLLazyJITBuilder().create();
+        if (!created)
+        {
+            return tl::unexpected(jitError(created.takeError()));
+        }
+        jit = std::move(*created);
+    }
+    else
+    {
+        auto created = llvm::orc::LLJITBuilder().create();
+        if (!created)
+        {
+            return tl::unexpected(jitError(created.takeError()));
+        }
+        jit = std::move(*created);
+    }
 
-    module->setDataLayout(TargetMachine->createDataLayout());
+    auto process =
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            jit->getDataLayout().getGlobalPrefix()
+        );
+    if (!process)
+    {
+        return tl::unexpected(jitError(process.takeError()));
+    }
+    jit->getMainJITDylib().addGenerator(std::move(*process));
+    return jit;
+}
 
-    std::error_code      EC;
-    llvm::raw_fd_ostream dest(output_file, EC, llvm::sys::fs::OF_None);
+// move module and its context into jit, which was created with the same lazy;
+// InitializeModule starts the next one
+auto AddModuleToJIT(llvm::orc::LLJIT &jit, bool lazy, CodeGenContext &cg)
+    -> ExpectedCodeGen<std::monostate>
+{
+    cg.module->setDataLayout(jit.getDataLayout());
+    cg.function_passes.reset();
+    cg.builder.reset();
+    cg.named_values.clear();
+    auto owned = llvm::orc::ThreadSafeModule(
+        std::move(cg.module), std::move(cg.context)
+    );
+    auto added =
+        lazy ? static_cast<llvm::orc::LLLazyJIT &>(jit).addLazyIRModule(
+                   std::move(owned)
+               )
+             : jit.addIRModule(std::move(owned));
+    if (added)
+    {
+        return tl::unexpected(jitError(std::move(added)));
+    }
+    return std::monostate{};
+}
 
-    if (EC)
+// address of the function name in jit, compiling it if it is not yet
+template <typename Signature>
+auto LookupJIT(llvm::orc::LLJIT &jit, std::string_view name)
+    -> ExpectedCodeGen<Signature *>
+{
+    auto symbol = jit.lookup(name);
+    if (!symbol)
     {
-        llvm::errs() << "Could not open file: " << EC.message();
-        return 1;
+        return tl::unexpected(jitError(symbol.takeError()));
     }
+    return llvm::jitTargetAddressToFunction<Signature *>(symbol->getAddress());
+}
 
-    auto                      FileType = llvm::CGFT_ObjectFile;
-    llvm::legacy::PassManager old_pass;
-    if (TargetMachine->addPassesToEmitFile(old_pass, dest, nullptr, FileType))
+// Hand module to a JIT of its own and call its main in this process.
+auto JITRunMain(bool lazy, CodeGenContext &cg) -> ExpectedCodeGen<int64_t>
+{
+    return CreateJIT(lazy) >>=
+           [lazy, &cg](std::unique_ptr<llvm::orc::LLJIT> &jit)
+    {
+        return AddModuleToJIT(*jit, lazy, cg) >>= [&jit](auto)
+        {
+            return LookupJIT<int64_t()>(*jit, "main") >>=
+                   [](auto *main_function) -> ExpectedCodeGen<int64_t>
+            {
+                return main_function();
+            };
+        };
+    };
+}
+
+// the objects GenObj writes for output_file: itself, or with more than one
+// partition a.o becomes a.0.o, a.1.o and so on
+inline auto objectFiles(std::string_view output_file, unsigned partitions)
+    -> std::vector<std::string>
+{
+    if (partitions <= 1)
     {
-        llvm::errs() << "TargetMachine can't emit a file of this type";
-        return 1;
+        return {std::string(output_file)};
     }
+    auto files = std::vector<std::string>{};
+    for (unsigned i = 0; i < partitions; i++)
+    {
+        auto path = std::filesystem::path(output_file);
+        auto extension = path.extension().string();
+        path.replace_extension(fmt::format(".{}{}", i, extension));
+        files.push_back(path.string());
+    }
+    return files;
+}
+
+// Emit module as object code and return the files written. With more than
+// one partition the module is split by function and the partitions are
+// emitted at once, each by a thread with its own context and target machine
+// set up like the shared one; they are linked together like any objects.
+// Optimization stays with Optimize, which sees the whole module.
+auto GenObj(
+    std::string_view output_file, unsigned partitions, CodeGenContext &cg
+) -> ExpectedCodeGen<std::vector<std::string>>
+{
+    return hostTargetMachine(cg) >>=
+           [output_file, partitions, &cg](llvm::TargetMachine *machine)
+               -> ExpectedCodeGen<std::vector<std::string>>
+    {
+        auto files   = objectFiles(output_file, partitions);
+        auto streams = std::vector<std::unique_ptr<llvm::raw_fd_ostream>>{};
+        for (const auto &file : files)
+        {
+            std::error_code EC;
+            streams.push_back(std::make_unique<llvm::raw_fd_ostream>(
+                file, EC, llvm::sys::fs::OF_None
+            ));
+            if (EC)
+            {
+                return tl::unexpected(ErrorCodeGen(
+                    ErrorCodeGen::Unknown,
+                    fmt::format("Could not open {}: {}", file, EC.message())
+                ));
+            }
+        }
 
-    old_pass.run(*module);
-    dest.flush();
-    llvm::outs() << "Wrote " << output_file << "\n";
-    return 1;
+        if (partitions <= 1)
+        {
+            llvm::legacy::PassManager old_pass;
+            if (machine->addPassesToEmitFile(
+                    old_pass, *streams.front(), nullptr, llvm::CGFT_ObjectFile
+                ))
+            {
+                return tl::unexpected(ErrorCodeGen(
+                    ErrorCodeGen::NotImplemented,
+                    "TargetMachine can't emit a file of this type"
+                ));
+            }
+            old_pass.run(*cg.module);
+        }
+        else
+        {
+            // partitions travel between contexts as bitcode, which must be
+            // valid to be read back
+            std::string              problems;
+            llvm::raw_string_ostream problems_os(problems);
+            if (llvm::verifyModule(*cg.module, &problems_os))
+            {
+                return tl::unexpected(
+                    ErrorCodeGen(ErrorCodeGen::Unknown, problems)
+                );
+            }
+            auto outputs = std::vector<llvm::raw_pwrite_stream *>{};
+            for (auto &stream : streams)
+            {
+                outputs.push_back(stream.get());
+            }
+            // createTargetMachine has already succeeded for the shared one
+            auto level   = machine->getOptLevel();
+            auto factory = [level, cpu = cg.target_cpu]
+            {
+                auto created   = createTargetMachine(cpu);
+                auto partition = std::move(created.value());
+                partition->setOptLevel(level);
+                return partition;
+            };
+            llvm::splitCodeGen(*cg.module, outputs, {}, factory);
+        }
+
+        for (auto &stream : streams)
+        {
+            stream->flush();
+        }
+        return files;
+    };
 }
+
 } // namespace xi
@@ -1,7 +1,10 @@
 #include "compiler/ast/all.h"
 #include "compiler/ast/type.h"
+#include "compiler/ast/visit.h"
 #include "compiler/generator/error.h"
 #include "compiler/generator/pcode.h"
+#include "compiler/utils/scoped_table.h"
+#include "compiler/utils/symbol.h"
 
 #include <spdlog/spdlog.h>
 
@@ -15,7 +18,7 @@ struct PCodeGenState
     std::vector<int64_t> cur_base;
     struct var
     {
-        std::string name;
+        Symbol      name;
         int64_t     level;
         int64_t     addr;
     };
@@ -25,11 +28,11 @@ struct PCodeGenState
         int64_t        level;
         int64_t        addr;
     };
-    std::stack<std::map<std::string, var>>  var_table;
-    std::stack<std::map<std::string, func>> func_table;
-    std::stack<int64_t>                     cur_offset;
-    std::stack<std::stack<int64_t>>         old_offset;
-    auto                                    Emit(Op op, int64_t l, int64_t a)
+    std::stack<ScopedTable<Symbol, var>>  var_table;
+    std::stack<ScopedTable<Symbol, func>> func_table;
+    std::stack<int64_t>                   cur_offset;
+    std::stack<std::stack<int64_t>>       old_offset;
+    auto                                  Emit(Op op, int64_t l, int64_t a)
     {
         return pcodes.push_back(PCode{op, l, a});
     }
@@ -39,8 +42,8 @@ struct PCodeGenState
         cur_base.push_back(0);
         cur_offset.push(0);
         old_offset.push(std::stack<int64_t>());
-        var_table.push(std::map<std::string, var>());
-        func_table.push(std::map<std::string, func>());
+        var_table.push(ScopedTable<Symbol, var>());
+        func_table.push(ScopedTable<Symbol, func>());
     }
 
     [[nodiscard]] auto NextLabel() const -> uint64_t { return pcodes.size(); }
@@ -64,8 +67,8 @@ struct PCodeGenState
 
     auto EnterBlock()
     {
-        var_table.emplace(var_table.top());
-        func_table.emplace(func_table.top());
+        var_table.emplace(var_table.top().Extend());
+        func_table.emplace(func_table.top().Extend());
         cur_offset.emplace(cur_offset.top());
     }
     auto LeaveBlock()
@@ -75,68 +78,93 @@ struct PCodeGenState
         cur_offset.pop();
     }
 
-    auto EnterVar(const std::string &name)
+    auto EnterVar(Symbol name)
     {
         auto &vt = var_table.top();
         vt.insert_or_assign(name, var{name, cur_level, cur_offset.top()});
         cur_offset.top()++;
     }
 
-    auto LookupVar(const std::string &name) -> var &
+    auto LookupVar(Symbol name) -> const var &
     {
-        auto &vt = var_table.top();
-        if (vt.contains(name))
+        if (const auto *v = var_table.top().find(name); v != nullptr)
         {
-            return vt[name];
+            return *v;
         }
         throw std::runtime_error("Variable not found");
     }
 
-    auto
-    EnterFunc(const std::string &name, const type::function &type, int64_t addr)
+    auto EnterFunc(Symbol name, const type::function &type, int64_t addr)
     {
         spdlog::info("EnterFunc: {}", name);
         auto &ft = func_table.top();
         ft.insert_or_assign(name, func{type, cur_level, addr});
     }
 
-    auto LookupFunc(const std::string &name) -> func &
+    auto LookupFunc(Symbol name) -> const func &
     {
-        auto &ft = func_table.top();
-        if (ft.contains(name))
+        if (const auto *f = func_table.top().find(name); f != nullptr)
         {
-            return ft[name];
+            return *f;
         }
         throw std::runtime_error("Function not found");
     }
 };
 
-void PCodeGen(Xi_Expr, PCodeGenState &);
-void PCodeGen(Xi_Stmt, PCodeGenState &);
-void PCodeGen(std::vector<Xi_Stmt>, PCodeGenState &);
-
-template <typename T>
-auto PCodeGen(recursive_wrapper<T> wrapper, PCodeGenState &st)
-{
-    return PCodeGen(wrapper.get(), st);
-}
+void PCodeGen(const Xi_Expr &, PCodeGenState &);
+void PCodeGen(const Xi_Stmt &, PCodeGenState &);
+void PCodeGen(const std::vector<Xi_Stmt> &, PCodeGenState &);
 
-auto PCodeGen(Xi_Integer i, PCodeGenState &st)
+auto PCodeGen(const Xi_Integer &i, PCodeGenState &st)
 {
     st.Emit(Op::lit, 0, i.value);
 }
 
-auto PCodeGen(Xi_Real, PCodeGenState &) {}
+auto PCodeGen(const Xi_Real &, PCodeGenState &) {}
 
-auto PCodeGen(Xi_String, PCodeGenState &) {}
+auto PCodeGen(const Xi_String &, PCodeGenState &) {}
 
-auto PCodeGen(Xi_Boolean b, PCodeGenState &st)
+auto PCodeGen(const Xi_Boolean &b, PCodeGenState &st)
 {
     st.Emit(Op::lit, 0, static_cast<int64_t>(b.value));
 }
 
-auto PCodeGen(Xi_Binop binop, PCodeGenState &st)
+// lhs && rhs and lhs || rhs run rhs only when lhs does not decide the value
+auto PCodeGenShortCircuit(const Xi_Binop &binop, PCodeGenState &st)
 {
+    PCodeGen(binop.lhs, st);
+    auto jpc_label = st.NextLabel();
+    st.Emit(Op::jpc, 0, 0);
+
+    if (binop.op == Xi_Op::And)
+    {
+        PCodeGen(binop.rhs, st);
+    }
+    else
+    {
+        st.Emit(Op::lit, 0, 1);
+    }
+    auto jmp_label = st.NextLabel();
+    st.Emit(Op::jmp, 0, 0);
+
+    st.pcodes[jpc_label].a = static_cast<int64_t>(st.NextLabel());
+    if (binop.op == Xi_Op::And)
+    {
+        st.Emit(Op::lit, 0, 0);
+    }
+    else
+    {
+        PCodeGen(binop.rhs, st);
+    }
+    st.pcodes[jmp_label].a = static_cast<int64_t>(st.NextLabel());
+}
+
+auto PCodeGen(const Xi_Binop &binop, PCodeGenState &st)
+{
+    if (binop.op == Xi_Op::And || binop.op == Xi_Op::Or)
+    {
+        return PCodeGenShortCircuit(binop, st);
+    }
     PCodeGen(binop.lhs, st);
     PCodeGen(binop.rhs, st);
     switch (binop.op)
@@ -163,10 +191,6 @@ auto PCodeGen(Xi_Binop binop, PCodeGenState &st)
         return st.Emit(Op::opr, 0, static_cast<int64_t>(Opr::Leq));
     case Xi_Op::Geq:
         return st.Emit(Op::opr, 0, static_cast<int64_t>(Opr::Geq));
-    case Xi_Op::And:
-        return st.Emit(Op::opr, 0, static_cast<int64_t>(Opr::And));
-    case Xi_Op::Or:
-        return st.Emit(Op::opr, 0, static_cast<int64_t>(Opr::Or));
     case Xi_Op::Xor:
         return st.Emit(Op::opr, 0, static_cast<int64_t>(Opr::Xor));
     default:
@@ -174,7 +198,7 @@ auto PCodeGen(Xi_Binop binop, PCodeGenState &st)
     }
 }
 
-auto PCodeGen(Xi_Unop unop, PCodeGenState &st)
+auto PCodeGen(const Xi_Unop &unop, PCodeGenState &st)
 {
     PCodeGen(unop.expr, st);
     switch (unop.op)
@@ -190,7 +214,7 @@ auto PCodeGen(Xi_Unop unop, PCodeGenState &st)
     }
 }
 
-auto PCodeGen(Xi_If_stmt if_stmt, PCodeGenState &st)
+auto PCodeGen(const Xi_If_stmt &if_stmt, PCodeGenState &st)
 {
     st.EnterBlock();
 
@@ -209,7 +233,7 @@ auto PCodeGen(Xi_If_stmt if_stmt, PCodeGenState &st)
     st.LeaveBlock();
 }
 
-auto PCodeGen(Xi_While while_stmt, PCodeGenState &st)
+auto PCodeGen(const Xi_While &while_stmt, PCodeGenState &st)
 {
     st.EnterBlock();
 
@@ -242,7 +266,7 @@ overloaded(Ts...) -> overloaded<Ts...>;
 // recursive_wrapper<function>,
 // recursive_wrapper<set>,
 // recursive_wrapper<types>,
-auto size(type::Xi_Type t) -> int64_t
+auto size(const type::Xi_Type &t) -> int64_t
 {
     return std::visit(
         overloaded{
@@ -274,7 +298,7 @@ auto size(type::Xi_Type t) -> int64_t
             {
                 return 1;
             },
-            [](recursive_wrapper<type::set> st)
+            [](const recursive_wrapper<type::set> &st)
             {
                 auto ans = 0;
                 for (auto &&[name, t_] : st.get().members)
@@ -295,38 +319,38 @@ auto size(type::Xi_Type t) -> int64_t
     );
 }
 
-auto PCodeGen(Xi_Var var, PCodeGenState &st)
+auto PCodeGen(const Xi_Var &var, PCodeGenState &st)
 {
     auto var_size = size(var.type);
     st.Emit(Op::ini, 0, var_size);
     st.EnterVar(var.name);
 }
 
-auto PCodeGen(Xi_Assign assign, PCodeGenState &st)
+auto PCodeGen(const Xi_Assign &assign, PCodeGenState &st)
 {
     PCodeGen(assign.expr, st);
     auto var = st.LookupVar(assign.name);
     st.Emit(Op::sto, st.cur_level - var.level, var.addr);
 }
 
-auto PCodeGen(Xi_Return rt, PCodeGenState &st)
+auto PCodeGen(const Xi_Return &rt, PCodeGenState &st)
 {
     PCodeGen(rt.expr, st);
     st.Emit(Op::ret, 0, size(rt.type));
 }
 
-auto PCodeGen(Xi_Comment /*unused*/, PCodeGenState /*unused*/) {}
+auto PCodeGen(const Xi_Comment & /*unused*/, PCodeGenState & /*unused*/) {}
 
-void PCodeGen(Xi_Decl decl, PCodeGenState &st)
+void PCodeGen(const Xi_Decl &decl, PCodeGenState &st)
 {
     return std::visit(
-        [decl, &st](auto decl_type_wrapper)
+        [&decl, &st](const auto &decl_type_wrapper)
         {
             if constexpr (std::same_as<
                               std::decay_t<decltype(decl_type_wrapper)>,
                               recursive_wrapper<type::function>>)
             {
-                auto decl_type = decl_type_wrapper.get();
+                const auto &decl_type = decl_type_wrapper.get();
                 st.EnterFunc(
                     decl.name, decl_type, static_cast<int64_t>(st.NextLabel())
                 );
@@ -341,14 +365,14 @@ void PCodeGen(Xi_Decl decl, PCodeGenState &st)
     );
 }
 
-void pCodeGenExprFunc(Xi_Func, PCodeGenState &) {}
+void pCodeGenExprFunc(const Xi_Func &, PCodeGenState &) {}
 
-void pCodeGenStmtFunc(Xi_Func func, PCodeGenState &st)
+void pCodeGenStmtFunc(const Xi_Func &func, PCodeGenState &st)
 {
     PCodeGen(func.stmts, st);
 }
 
-void PCodeGen(Xi_Func func, PCodeGenState &st)
+void PCodeGen(const Xi_Func &func, PCodeGenState &st)
 {
     st.EnterNextLevel(static_cast<int64_t>(func.params.size()));
 
@@ -370,9 +394,9 @@ void PCodeGen(Xi_Func func, PCodeGenState &st)
     st.LeaveCurLevel();
 }
 
-void PCodeGen(Xi_Array, PCodeGenState &) {}
+void PCodeGen(const Xi_Array &, PCodeGenState &) {}
 
-void PCodeGen(Xi_Call func, PCodeGenState &st)
+void PCodeGen(const Xi_Call &func, PCodeGenState &st)
 {
     auto f = st.LookupFunc(func.name);
     st.Emit(Op::cap, st.cur_level - f.level, f.addr);
@@ -383,22 +407,22 @@ void PCodeGen(Xi_Call func, PCodeGenState &st)
     st.Emit(Op::cal, 0, f.addr);
 }
 
-void PCodeGen(Xi_Lam, PCodeGenState &) {}
-void PCodeGen(Xi_If, PCodeGenState &) {}
+void PCodeGen(const Xi_Lam &, PCodeGenState &) {}
+void PCodeGen(const Xi_If &, PCodeGenState &) {}
 
-void PCodeGen(Xi_Iden iden, PCodeGenState &st)
+void PCodeGen(const Xi_Iden &iden, PCodeGenState &st)
 {
     auto var = st.LookupVar(iden.name);
     st.Emit(Op::lod, st.cur_level - var.level, var.addr);
 }
 
-void PCodeGen(Xi_ArrayIndex, PCodeGenState &) {}
+void PCodeGen(const Xi_ArrayIndex &, PCodeGenState &) {}
 void PCodeGen(std::monostate, PCodeGenState &) {}
 
-void PCodeGen(Xi_Expr expr, PCodeGenState &st)
+void PCodeGen(const Xi_Expr &expr, PCodeGenState &st)
 {
-    return std::visit(
-        [&](auto arg)
+    return Visit(
+        [&](const auto &arg)
         {
             PCodeGen(arg, st);
         },
@@ -406,17 +430,17 @@ void PCodeGen(Xi_Expr expr, PCodeGenState &st)
     );
 }
 
-void PCodeGen(Xi_Stmt stmt, PCodeGenState &st)
+void PCodeGen(const Xi_Stmt &stmt, PCodeGenState &st)
 {
-    return std::visit(
-        [&](auto arg)
+    return Visit(
+        [&](const auto &arg)
         {
             PCodeGen(arg, st);
         },
         stmt
     );
 }
-void PCodeGen(std::vector<Xi_Stmt> stmts, PCodeGenState &st)
+void PCodeGen(const std::vector<Xi_Stmt> &stmts, PCodeGenState &st)
 {
     for (auto &&stmt : stmts)
     {
@@ -424,7 +448,7 @@ void PCodeGen(std::vector<Xi_Stmt> stmts, PCodeGenState &st)
     }
 }
 
-void PCodeGen(Xi_Stmts stmts, PCodeGenState &st)
+void PCodeGen(const Xi_Stmts &stmts, PCodeGenState &st)
 {
     for (auto &&stmt : stmts.stmts)
     {
@@ -432,7 +456,7 @@ void PCodeGen(Xi_Stmts stmts, PCodeGenState &st)
     }
 }
 
-auto PCodeGen(Xi_Program program) -> ExpectedCodeGen<std::vector<PCode>>
+auto PCodeGen(const Xi_Program &program) -> ExpectedCodeGen<std::vector<PCode>>
 {
     PCodeGenState st;
     PCodeGen(program.stmts, st);
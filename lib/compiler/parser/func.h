@@ -37,7 +37,7 @@ const auto Xi_expr_func = s_iden >> [](std::string name)
             {
                 return unit(Xi_Stmt{Xi_Func{
                     .name      = name,
-                    .params    = params,
+                    .params    = {params.begin(), params.end()},
                     .expr      = std::move(expr),
                     .let_idens = idens.value_or(std::vector<Xi_Iden>{}),
                 }});
@@ -56,7 +56,8 @@ const auto Xi_decl_func = s_iden >> [](std::string name)
             return token(symbol('}')) > unit(Xi_Stmt{
                                             Xi_Func{
                                                 .name      = name,
-                                                .params    = params,
+                                                .params    = {params.begin(),
+                                                              params.end()},
                                                 .expr      = std::monostate{},
                                                 .let_idens = {},
                                                 .stmts     = stmts,
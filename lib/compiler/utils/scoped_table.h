@@ -0,0 +1,91 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace xi
+{
+
+// A persistent symbol table built from parent-linked frames.
+//
+// Copying a table only copies a pointer to its innermost frame, so passing
+// it by value is O(1) and all copies share their common outer frames. A new
+// binding goes into the innermost frame when this handle owns it exclusively;
+// if the frame is shared with another copy, a fresh frame is pushed in front
+// of it first, so the other copies never observe the binding. Lookups walk
+// the frames from the innermost outwards and inner bindings shadow outer
+// ones.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ScopedTable
+{
+    struct Frame
+    {
+        std::unordered_map<Key, Value, Hash> bindings;
+        std::shared_ptr<Frame>               parent;
+    };
+
+    std::shared_ptr<Frame> head_;
+
+    auto ownedFrame() -> Frame &
+    {
+        if (head_ == nullptr || head_.use_count() != 1)
+        {
+            head_ = std::make_shared<Frame>(Frame{{}, std::move(head_)});
+        }
+        return *head_;
+    }
+
+  public:
+    ScopedTable() = default;
+
+    // find the innermost binding of key, nullptr if it is unbound
+    [[nodiscard]] auto find(const Key &key) const -> const Value *
+    {
+        for (const auto *frame = head_.get(); frame != nullptr;
+             frame             = frame->parent.get())
+        {
+            if (auto it = frame->bindings.find(key);
+                it != frame->bindings.end())
+            {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] auto contains(const Key &key) const -> bool
+    {
+        return find(key) != nullptr;
+    }
+
+    // bind key in the innermost scope, shadowing any outer binding
+    void insert_or_assign(Key key, Value value)
+    {
+        ownedFrame().bindings.insert_or_assign(
+            std::move(key), std::move(value)
+        );
+    }
+
+    // bind key only if it is not visible yet
+    auto insert(std::pair<Key, Value> binding) -> bool
+    {
+        if (contains(binding.first))
+        {
+            return false;
+        }
+        insert_or_assign(std::move(binding.first), std::move(binding.second));
+        return true;
+    }
+
+    // open a nested scope that shares every binding of this one
+    [[nodiscard]] auto Extend() const -> ScopedTable
+    {
+        auto child  = ScopedTable{};
+        child.head_ = std::make_shared<Frame>(Frame{{}, head_});
+        return child;
+    }
+};
+
+} // namespace xi
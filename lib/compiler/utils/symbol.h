@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xi
+{
+
+// Owns the text of every interned identifier.
+//
+// Each distinct name gets a dense id, in order of first appearance. Interning
+// takes a lock, reading a name back does not: names are kept in chunks that
+// never move, chunk k holding FirstChunk << k of them, so the text of an id
+// is found by arithmetic on it and stays put while new names are added.
+class Interner
+{
+    static constexpr uint32_t FirstChunk = 1024;
+    // enough chunks for every uint32_t id
+    static constexpr size_t   Chunks     = 23;
+
+    std::array<std::unique_ptr<std::string[]>, Chunks> owned_;
+    std::array<std::atomic<std::string *>, Chunks>     chunks_{};
+    std::atomic<uint32_t>                              size_ = 0;
+    std::unordered_map<std::string_view, uint32_t>     ids_;
+    std::mutex                                         mutex_;
+
+    static auto chunkOf(uint32_t id) -> size_t
+    {
+        return std::bit_width(id / FirstChunk + 1) - 1;
+    }
+
+    // the id of the first name in chunk
+    static auto chunkStart(size_t chunk) -> uint32_t
+    {
+        return FirstChunk * ((uint32_t{1} << chunk) - 1);
+    }
+
+  public:
+    // the empty name is always id 0, so default symbols need no lookup
+    Interner() { Intern(""); }
+
+    auto Intern(std::string_view name) -> uint32_t
+    {
+        auto lock = std::scoped_lock{mutex_};
+        if (auto it = ids_.find(name); it != ids_.end())
+        {
+            return it->second;
+        }
+        auto  id    = size_.load(std::memory_order_relaxed);
+        auto  chunk = chunkOf(id);
+        auto *names = chunks_[chunk].load(std::memory_order_relaxed);
+        if (names == nullptr)
+        {
+            owned_[chunk] =
+                std::make_unique<std::string[]>(FirstChunk << chunk);
+            names = owned_[chunk].get();
+            chunks_[chunk].store(names, std::memory_order_release);
+        }
+        auto &stored = names[id - chunkStart(chunk)];
+        stored       = name;
+        ids_.emplace(stored, id);
+        size_.store(id + 1, std::memory_order_release);
+        return id;
+    }
+
+    // id came from Intern, so its chunk is already in place
+    [[nodiscard]] auto Name(uint32_t id) const -> const std::string &
+    {
+        auto        chunk = chunkOf(id);
+        const auto *names = chunks_[chunk].load(std::memory_order_acquire);
+        return names[id - chunkStart(chunk)];
+    }
+
+    [[nodiscard]] auto Size() const -> size_t
+    {
+        return size_.load(std::memory_order_acquire);
+    }
+};
+
+inline auto GetInterner() -> Interner &
+{
+    static Interner interner;
+    return interner;
+}
+
+// An interned identifier.
+//
+// Comparing, hashing and copying a Symbol only touches its id; the text is
+// looked up in the interner when it is printed or handed to LLVM.
+class Symbol
+{
+    uint32_t id_;
+
+  public:
+    Symbol() : id_(0) {}
+    Symbol(std::string_view name) : id_(GetInterner().Intern(name)) {} // NOLINT
+    Symbol(const std::string &name) : Symbol(std::string_view{name}) {} // NOLINT
+    Symbol(const char *name) : Symbol(std::string_view{name}) {}        // NOLINT
+
+    [[nodiscard]] auto id() const -> uint32_t { return id_; }
+    [[nodiscard]] auto str() const -> const std::string &
+    {
+        return GetInterner().Name(id_);
+    }
+    [[nodiscard]] auto c_str() const -> const char * { return str().c_str(); }
+    [[nodiscard]] auto empty() const -> bool { return id_ == 0; }
+
+    operator const std::string &() const { return str(); } // NOLINT
+
+    auto operator==(const Symbol &rhs) const -> bool = default;
+    auto operator<=>(const Symbol &rhs) const -> std::strong_ordering
+    {
+        return id_ <=> rhs.id_;
+    }
+};
+
+// A map from symbols to values stored in a flat array indexed by symbol id.
+//
+// Lookups are a bounds check and an index. The ids in use are remembered so
+// clear() only touches the slots that were filled.
+template <typename T>
+class SymbolMap
+{
+    std::vector<std::optional<T>> slots_;
+    std::vector<Symbol>           keys_;
+
+  public:
+    [[nodiscard]] auto find(Symbol key) const -> const T *
+    {
+        if (key.id() >= slots_.size() || !slots_[key.id()].has_value())
+        {
+            return nullptr;
+        }
+        return &*slots_[key.id()];
+    }
+
+    [[nodiscard]] auto find(Symbol key) -> T *
+    {
+        if (key.id() >= slots_.size() || !slots_[key.id()].has_value())
+        {
+            return nullptr;
+        }
+        return &*slots_[key.id()];
+    }
+
+    [[nodiscard]] auto contains(Symbol key) const -> bool
+    {
+        return find(key) != nullptr;
+    }
+
+    void insert_or_assign(Symbol key, T value)
+    {
+        if (key.id() >= slots_.size())
+        {
+            slots_.resize(key.id() + 1);
+        }
+        if (!slots_[key.id()].has_value())
+        {
+            keys_.push_back(key);
+        }
+        slots_[key.id()] = std::move(value);
+    }
+
+    // bind key only if it has no value yet
+    auto insert(Symbol key, T value) -> bool
+    {
+        if (contains(key))
+        {
+            return false;
+        }
+        insert_or_assign(key, std::move(value));
+        return true;
+    }
+
+    void clear()
+    {
+        for (auto key : keys_)
+        {
+            slots_[key.id()].reset();
+        }
+        keys_.clear();
+    }
+
+    [[nodiscard]] auto keys() const -> const std::vector<Symbol> &
+    {
+        return keys_;
+    }
+    [[nodiscard]] auto size() const -> size_t { return keys_.size(); }
+    [[nodiscard]] auto empty() const -> bool { return keys_.empty(); }
+};
+
+} // namespace xi
+
+template <>
+struct std::hash<xi::Symbol>
+{
+    auto operator()(const xi::Symbol &symbol) const noexcept -> size_t
+    {
+        return symbol.id();
+    }
+};
+
+template <>
+struct fmt::formatter<xi::Symbol> : fmt::formatter<std::string_view>
+{
+    template <typename FormatContext>
+    auto format(const xi::Symbol &symbol, FormatContext &ctx) const
+    {
+        return fmt::formatter<std::string_view>::format(symbol.str(), ctx);
+    }
+};
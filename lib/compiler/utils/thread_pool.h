@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xi
+{
+
+// A fixed set of worker threads draining a shared task queue.
+//
+// Workers are started once and live as long as the pool, so handing work to
+// the pool costs a queue push rather than a thread start.
+class ThreadPool
+{
+    std::deque<std::function<void()>> tasks_;
+    std::mutex                        mutex_;
+    std::condition_variable           ready_;
+    bool                              stop_ = false;
+    // declared last so the threads are joined before the queue goes away
+    std::vector<std::jthread> workers_;
+
+    void work()
+    {
+        while (true)
+        {
+            auto task = std::function<void()>{};
+            {
+                auto lock = std::unique_lock{mutex_};
+                ready_.wait(
+                    lock,
+                    [this]
+                    {
+                        return stop_ || !tasks_.empty();
+                    }
+                );
+                if (stop_ && tasks_.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+  public:
+    explicit ThreadPool(
+        size_t threads = std::max(1U, std::thread::hardware_concurrency())
+    )
+    {
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            workers_.emplace_back(
+                [this]
+                {
+                    work();
+                }
+            );
+        }
+    }
+
+    ThreadPool(const ThreadPool &)                     = delete;
+    auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+    ~ThreadPool()
+    {
+        {
+            auto lock = std::scoped_lock{mutex_};
+            stop_     = true;
+        }
+        ready_.notify_all();
+    }
+
+    [[nodiscard]] auto Size() const -> size_t { return workers_.size(); }
+
+    template <typename F>
+    auto Submit(F func) -> std::future<std::invoke_result_t<F>>
+    {
+        using Result = std::invoke_result_t<F>;
+        auto task =
+            std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        auto result = task->get_future();
+        {
+            auto lock = std::scoped_lock{mutex_};
+            tasks_.emplace_back(
+                [task]
+                {
+                    (*task)();
+                }
+            );
+        }
+        ready_.notify_one();
+        return result;
+    }
+
+    // call func(i) for every i in [0, count) and wait for all of them.
+    //
+    // Indices are handed out one at a time from a shared counter, so uneven
+    // items balance across workers. The calling thread takes indices too,
+    // which keeps a ParallelFor issued from inside a task from deadlocking.
+    // If func throws, the first exception is rethrown once every helper is
+    // done, since helpers use next and func from this frame until then.
+    template <typename F>
+    void ParallelFor(size_t count, F &&func)
+    {
+        auto next  = std::atomic<size_t>{0};
+        auto drain = [&next, &func, count]
+        {
+            for (auto i = next++; i < count; i = next++)
+            {
+                func(i);
+            }
+        };
+
+        auto helpers = std::min(Size(), count) - (count > 0 ? 1 : 0);
+        auto pending = std::vector<std::future<void>>{};
+        pending.reserve(helpers);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            pending.push_back(Submit(drain));
+        }
+        auto error = std::exception_ptr{};
+        try
+        {
+            drain();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        for (auto &helper : pending)
+        {
+            try
+            {
+                helper.get();
+            }
+            catch (...)
+            {
+                if (error == nullptr)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error != nullptr)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+inline auto GetThreadPool() -> ThreadPool &
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+} // namespace xi
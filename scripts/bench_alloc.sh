@@ -0,0 +1,55 @@
+#!/bin/bash
+#
+# Compile allocation-heavy demo programs with arrays from malloc and from the
+# bump arena and time their runs.
+#
+#   scripts/bench_alloc.sh [demo.xi...]
+#
+# XIC names the compiler binary (default build/app/compiler/compiler), LEVEL
+# the optimization level (default 2) and RUNS the number of timed runs per
+# mode, the best of which is reported. The peak column is the most memory a
+# run held, where /usr/bin/time can tell.
+
+XIC=${XIC:-build/app/compiler/compiler}
+LEVEL=${LEVEL:-2}
+RUNS=${RUNS:-5}
+DEMOS=${*:-demo/alloc.xi demo/reuse.xi}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ ! -x "$XIC" ]; then
+    echo "compiler not found at $XIC, set XIC"
+    exit 1
+fi
+
+printf "%-12s%10s%10s%10s%10s\n" "demo" "malloc" "peak" "arena" "peak"
+
+for demo in $DEMOS; do
+    name=$(basename "$demo" .xi)
+    printf "%-12s" "$name"
+    for mode in malloc arena; do
+        exe="$OUT/$name-$mode"
+        if ! "$XIC" --llvm -O"$LEVEL" --alloc=$mode --o="$exe" "$demo" \
+            >/dev/null 2>&1; then
+            printf "%10s%10s" "fail" ""
+            continue
+        fi
+        best=""
+        for _ in $(seq "$RUNS"); do
+            start=$(date +%s%N)
+            "$exe" >/dev/null 2>&1
+            end=$(date +%s%N)
+            took=$(((end - start) / 1000000))
+            if [ -z "$best" ] || [ "$took" -lt "$best" ]; then
+                best=$took
+            fi
+        done
+        peak="-"
+        if [ -x /usr/bin/time ]; then
+            kb=$(/usr/bin/time -f "%M" "$exe" 2>&1 >/dev/null | tail -1)
+            peak="$((kb / 1024))MB"
+        fi
+        printf "%8sms%10s" "$best" "$peak"
+    done
+    printf "\n"
+done
@@ -0,0 +1,49 @@
+#!/bin/bash
+#
+# Time compiling a generated program of many functions with the object code
+# emitted by one thread and by several.
+#
+#   scripts/bench_codegen.sh [functions]
+#
+# XIC names the compiler binary (default build/app/compiler/compiler), LEVEL
+# the optimization level (default 2) and THREADS the --codegen_threads values
+# to compare (default 1 2 4 8).
+
+XIC=${XIC:-build/app/compiler/compiler}
+LEVEL=${LEVEL:-2}
+THREADS=${THREADS:-1 2 4 8}
+FUNCTIONS=${1:-2000}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ ! -x "$XIC" ]; then
+    echo "compiler not found at $XIC, set XIC"
+    exit 1
+fi
+
+# f0 x = x, fi x = if x < i then fi-1 @ x + i else fi-1 @ x - i
+program="$OUT/many.xi"
+{
+    echo "fn printf :: string -> ... -> i64"
+    echo "fn f0 :: i64 -> i64"
+    echo "f0 x = x"
+    for i in $(seq "$FUNCTIONS"); do
+        echo "fn f$i :: i64 -> i64"
+        echo "f$i x = if x < $i then (f$((i - 1)) @ x) + $i" \
+            "else (f$((i - 1)) @ x) - $i"
+    done
+    echo "fn main :: i64"
+    echo "main = printf @ \"%ld\" f$FUNCTIONS @ 7"
+} >"$program"
+
+printf "%-10s%10s\n" "threads" "compile"
+for threads in $THREADS; do
+    start=$(date +%s%N)
+    if ! "$XIC" --llvm -O"$LEVEL" --codegen_threads="$threads" \
+        --o="$OUT/many" "$program" >/dev/null 2>&1; then
+        printf "%-10s%10s\n" "$threads" "fail"
+        continue
+    fi
+    end=$(date +%s%N)
+    printf "%-10s%8sms\n" "$threads" "$(((end - start) / 1000000))"
+done
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Compile demo programs for a generic CPU and for this host and time their runs.
+#
+#   scripts/bench_march.sh [demo.xi...]
+#
+# XIC names the compiler binary (default build/app/compiler/compiler), LEVEL
+# the optimization level (default 3) and RUNS the number of timed runs per
+# target, the best of which is reported. The vector column counts the vector
+# instructions the loop vectorizer left in the IR.
+
+XIC=${XIC:-build/app/compiler/compiler}
+LEVEL=${LEVEL:-3}
+RUNS=${RUNS:-5}
+DEMOS=${*:-demo/squares.xi demo/fib.xi}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ ! -x "$XIC" ]; then
+    echo "compiler not found at $XIC, set XIC"
+    exit 1
+fi
+
+printf "%-12s%10s%10s%10s%10s\n" "demo" "generic" "vector" "native" "vector"
+
+for demo in $DEMOS; do
+    name=$(basename "$demo" .xi)
+    printf "%-12s" "$name"
+    for target in generic native; do
+        exe="$OUT/$name-$target"
+        if ! "$XIC" --llvm -O"$LEVEL" --march="$target" --o="$exe" "$demo" \
+            >/dev/null 2>&1; then
+            printf "%10s%10s" "fail" "-"
+            continue
+        fi
+        best=""
+        for _ in $(seq "$RUNS"); do
+            start=$(date +%s%N)
+            "$exe" >/dev/null 2>&1
+            end=$(date +%s%N)
+            took=$(((end - start) / 1000000))
+            if [ -z "$best" ] || [ "$took" -lt "$best" ]; then
+                best=$took
+            fi
+        done
+        vector=$(grep -c "<[0-9]* x " "$exe.ll")
+        printf "%8sms%10s" "$best" "$vector"
+    done
+    printf "\n"
+done
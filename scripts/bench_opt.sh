@@ -0,0 +1,49 @@
+#!/bin/bash
+#
+# Compile demo programs at every optimization level and time their runs.
+#
+#   scripts/bench_opt.sh [demo.xi...]
+#
+# XIC names the compiler binary (default build/app/compiler/compiler) and RUNS
+# the number of timed runs per level, the best of which is reported.
+
+XIC=${XIC:-build/app/compiler/compiler}
+RUNS=${RUNS:-5}
+DEMOS=${*:-demo/fib.xi demo/prime.xi}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ ! -x "$XIC" ]; then
+    echo "compiler not found at $XIC, set XIC"
+    exit 1
+fi
+
+printf "%-12s" "demo"
+for level in 0 1 2 3 s; do
+    printf "%10s" "-O$level"
+done
+printf "\n"
+
+for demo in $DEMOS; do
+    name=$(basename "$demo" .xi)
+    printf "%-12s" "$name"
+    for level in 0 1 2 3 s; do
+        exe="$OUT/$name-O$level"
+        if ! "$XIC" --llvm -O$level --o="$exe" "$demo" >/dev/null 2>&1; then
+            printf "%10s" "fail"
+            continue
+        fi
+        best=""
+        for _ in $(seq "$RUNS"); do
+            start=$(date +%s%N)
+            "$exe" >/dev/null 2>&1
+            end=$(date +%s%N)
+            took=$(((end - start) / 1000000))
+            if [ -z "$best" ] || [ "$took" -lt "$best" ]; then
+                best=$took
+            fi
+        done
+        printf "%8sms" "$best"
+    done
+    printf "\n"
+done
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Time compiling a generated main of thousands of statements, to see how the
+# front end grows with the length of a single function.
+#
+#   scripts/bench_stmts.sh [statements...]
+#
+# XIC names the compiler binary (default build/app/compiler/compiler). Each
+# count of statements (default 1000 2000 4000 8000) is compiled at -O0, so
+# the time is that of parsing, type assignment and code generation; it should
+# double, not quadruple, as the count does.
+
+XIC=${XIC:-build/app/compiler/compiler}
+COUNTS=${*:-1000 2000 4000 8000}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+if [ ! -x "$XIC" ]; then
+    echo "compiler not found at $XIC, set XIC"
+    exit 1
+fi
+
+printf "%-12s%10s\n" "statements" "compile"
+for count in $COUNTS; do
+    # main = { i64 v0 = 0; ... i64 vn = n; return 0; }
+    program="$OUT/stmts$count.xi"
+    {
+        echo "fn main :: i64"
+        echo "main = {"
+        for i in $(seq 0 $((count - 1))); do
+            echo "    i64 v$i = $i;"
+        done
+        echo "    return 0;"
+        echo "}"
+    } >"$program"
+
+    start=$(date +%s%N)
+    if ! "$XIC" --llvm -O0 --o="$OUT/stmts$count" "$program" \
+        >/dev/null 2>&1; then
+        printf "%-12s%10s\n" "$count" "fail"
+        continue
+    fi
+    end=$(date +%s%N)
+    printf "%-12s%8sms\n" "$count" "$(((end - start) / 1000000))"
+done
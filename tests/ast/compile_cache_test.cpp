@@ -0,0 +1,65 @@
+#include "test_header.h"
+
+#include <compiler/ast/all.h>
+#include <compiler/ast/compile_cache.h>
+#include <compiler/ast/fingerprint.h>
+#include <compiler/ast/type_assign.h>
+
+namespace xi
+{
+
+TEST_CASE("Fingerprint follows referenced signatures")
+{
+    ClearTypeAssignState();
+    auto caller = Xi_Func{
+        .name   = "g",
+        .params = {"x"},
+        .expr   = Xi_Call{.name = "f", .args = {iden("x")}},
+    };
+    REQUIRE(References(caller) == std::vector<Symbol>{"f", "g", "x"});
+
+    auto &functions = GetSymbolTable().functions;
+    functions.insert_or_assign("f", type::function{type::i64{}, {type::i64{}}});
+    auto before = FunctionFingerprint(caller, {});
+
+    // an unrelated declaration leaves it alone
+    functions.insert_or_assign("h", type::real{});
+    REQUIRE(FunctionFingerprint(caller, {}) == before);
+
+    functions.insert_or_assign(
+        "f", type::function{type::real{}, {type::i64{}}}
+    );
+    REQUIRE(FunctionFingerprint(caller, {}) != before);
+
+    auto edited = caller;
+    edited.expr = Xi_Call{.name = "f", .args = {Xi_Integer{1}}};
+    REQUIRE(FunctionFingerprint(edited, {}) != FunctionFingerprint(caller, {}));
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Type assign reuses unchanged functions")
+{
+    auto cache = FunctionCache{};
+
+    ClearTypeAssignState();
+    auto program = makeCallerProgram(1);
+    REQUIRE(TypeAssign(program, cache).has_value());
+    REQUIRE(cache.GetStats().type_misses == 2);
+
+    // same source, both bodies come from the cache with their annotations
+    ClearTypeAssignState();
+    auto again = makeCallerProgram(1);
+    REQUIRE(TypeAssign(again, cache).has_value());
+    REQUIRE(cache.GetStats().type_hits == 2);
+    REQUIRE(again == program);
+
+    // a body edit that keeps the signature leaves the caller cached
+    ClearTypeAssignState();
+    auto edited = makeCallerProgram(2);
+    REQUIRE(TypeAssign(edited, cache).has_value());
+    REQUIRE(cache.GetStats().type_hits == 3);
+    REQUIRE(cache.GetStats().type_misses == 3);
+    ClearTypeAssignState();
+}
+
+} // namespace xi
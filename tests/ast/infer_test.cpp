@@ -0,0 +1,166 @@
+#include "test_header.h"
+
+#include <compiler/ast/all.h>
+#include <compiler/ast/infer.h>
+#include <compiler/ast/type_assign.h>
+
+namespace xi
+{
+
+auto i64_fn(size_t arity) -> type::Xi_Type
+{
+    return type::function{
+        type::i64{}, std::vector<type::Xi_Type>(arity, type::i64{})};
+}
+
+TEST_CASE("Unify links variables in place")
+{
+    auto st = InferState{};
+    auto a  = st.Fresh();
+    auto b  = st.Fresh();
+    auto c  = st.Fresh();
+    REQUIRE(st.Unify(a, b).has_value());
+    REQUIRE(st.Unify(b, c).has_value());
+    REQUIRE(st.Find(a) == st.Find(c));
+    REQUIRE(st.Resolve(a) == type::Xi_Type{type::unknown{}});
+
+    REQUIRE(st.Unify(c, st.Builtin(InferState::Real)).has_value());
+    REQUIRE(st.Resolve(a) == type::Xi_Type{type::real{}});
+    REQUIRE(!st.Unify(b, st.Builtin(InferState::Buer)).has_value());
+}
+
+TEST_CASE("Unify function terms")
+{
+    auto st = InferState{};
+    auto x  = st.Fresh();
+    auto y  = st.Fresh();
+    auto f  = st.Function(x, {st.Builtin(InferState::I64)});
+    auto g  = st.Function(st.Builtin(InferState::Buer), {y});
+    REQUIRE(st.Unify(f, g).has_value());
+    REQUIRE(
+        st.Resolve(f) ==
+        type::Xi_Type{type::function{type::buer{}, {type::i64{}}}}
+    );
+
+    // a variable cannot contain itself
+    auto z = st.Fresh();
+    REQUIRE(!st.Unify(z, st.Array(z)).has_value());
+}
+
+TEST_CASE("Infer lambda")
+{
+    auto add = Xi_Lam{
+        .args = {iden("x"), iden("y")},
+        .body =
+            Xi_Binop{
+                Xi_Binop{iden("x"), iden("y"), Xi_Op::Add},
+                Xi_Integer{1},
+                Xi_Op::Add,
+            },
+    };
+    REQUIRE(TypeAssign(add, {}).value() == i64_fn(2));
+    REQUIRE(add.args[0].type == type::Xi_Type{type::i64{}});
+
+    // free variables come from the enclosing record
+    auto record = LocalVariableRecord{};
+    record.insert({"r", type::real{}});
+    auto scale = Xi_Lam{
+        .args = {iden("x")},
+        .body = Xi_Binop{iden("x"), iden("r"), Xi_Op::Mul},
+    };
+    REQUIRE(
+        TypeAssign(scale, record).value() ==
+        type::Xi_Type{type::function{type::real{}, {type::real{}}}}
+    );
+
+    // a numeric variable nothing pins down defaults to i64
+    auto sum = Xi_Lam{
+        .args = {iden("x"), iden("y")},
+        .body = Xi_Binop{iden("x"), iden("y"), Xi_Op::Add},
+    };
+    REQUIRE(TypeAssign(sum, {}).value() == i64_fn(2));
+
+    auto bad = Xi_Lam{
+        .args = {iden("x")},
+        .body =
+            Xi_If{
+                iden("x"),
+                Xi_Binop{iden("x"), Xi_Integer{1}, Xi_Op::Add},
+                Xi_Integer{0},
+            },
+    };
+    auto bad_type = TypeAssign(bad, {});
+    REQUIRE(!bad_type.has_value());
+    REQUIRE(bad_type.error().err == TypeAssignError::TypeMismatch);
+}
+
+TEST_CASE("Infer let-bound helpers")
+{
+    ClearTypeAssignState();
+    // let id = ? x -> x
+    //     inc = ? x -> x + 1
+    // in if id @ true then inc @ (id @ n) else 0
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "f", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "f",
+            .params = {"n"},
+            .expr =
+                Xi_If{
+                    Xi_Call{.name = "id", .args = {Xi_Boolean{true}}},
+                    Xi_Call{
+                        .name = "inc",
+                        .args = {Xi_Call{.name = "id", .args = {iden("n")}}},
+                    },
+                    Xi_Integer{0},
+                },
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "id",
+                        .expr =
+                            Xi_Lam{.args = {iden("x")}, .body = iden("x")},
+                    },
+                    Xi_Iden{
+                        .name = "inc",
+                        .expr =
+                            Xi_Lam{
+                                .args = {iden("x")},
+                                .body = Xi_Binop{
+                                    iden("x"), Xi_Integer{1}, Xi_Op::Add},
+                            },
+                    },
+                },
+        },
+    }};
+    REQUIRE(TypeAssign(program).has_value());
+    const auto &func =
+        std::get<recursive_wrapper<Xi_Func>>(program.stmts[1]).get();
+    REQUIRE(func.let_idens[1].type == i64_fn(1));
+
+    ClearTypeAssignState();
+    // let inc = ? x -> x + 1 in inc @ true
+    auto mismatch = Xi_Program{{
+        Xi_Decl{.name = "g", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "g",
+            .params = {},
+            .expr   = Xi_Call{.name = "inc", .args = {Xi_Boolean{true}}},
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "inc",
+                        .expr =
+                            Xi_Lam{
+                                .args = {iden("x")},
+                                .body = Xi_Binop{
+                                    iden("x"), Xi_Integer{1}, Xi_Op::Add},
+                            },
+                    },
+                },
+        },
+    }};
+    REQUIRE(!TypeAssign(mismatch).has_value());
+}
+
+} // namespace xi
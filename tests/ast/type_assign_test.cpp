@@ -385,6 +385,9 @@ TEST_CASE("Type Assign Unop")
     auto                sub = Xi_Unop{Xi_Integer{2}, Xi_Op::Sub};
     REQUIRE_THAT(TypeAssign(sub, record), TypeAssignMatcher(type::i64{}));
 
+    auto negate = Xi_Unop{Xi_Real{2.0}, Xi_Op::Sub};
+    REQUIRE_THAT(TypeAssign(negate, record), TypeAssignMatcher(type::real{}));
+
     auto not_ = Xi_Unop{Xi_Boolean{true}, Xi_Op::Not};
     REQUIRE_THAT(TypeAssign(not_, record), TypeAssignMatcher(type::buer{}));
 }
@@ -834,4 +837,87 @@ TEST_CASE("Assign decl func")
     );
 }
 
+// `size` functions `fi x = x + i`, each after its declaration
+auto makeManyFunctions(size_t size) -> Xi_Program
+{
+    auto program = Xi_Program{};
+    program.stmts.reserve(2 * size);
+    for (size_t i = 0; i < size; i++)
+    {
+        auto name = fmt::format("f{}", i);
+        program.stmts.emplace_back(Xi_Decl{
+            .name = name, .return_type = "i64", .params_type = {"i64"}});
+        program.stmts.emplace_back(Xi_Func{
+            .name   = name,
+            .params = {"x"},
+            .expr =
+                Xi_Binop{
+                    .lhs = Xi_Iden{.name = "x", .expr = std::monostate{}},
+                    .rhs = Xi_Integer{static_cast<int64_t>(i)},
+                    .op  = Xi_Op::Add,
+                },
+        });
+    }
+    return program;
+}
+
+TEST_CASE("Assign program with many functions")
+{
+    ClearTypeAssignState();
+    auto program = makeManyFunctions(200);
+    auto types   = TypeAssign(program);
+    REQUIRE(types.has_value());
+    REQUIRE(types.value().size() == 400);
+    auto f_type = type::Xi_Type{type::function{type::i64{}, {type::i64{}}}};
+    REQUIRE(ranges::all_of(
+        types.value(),
+        [&f_type](const auto &t)
+        {
+            return t == f_type;
+        }
+    ));
+
+    // the second definition of a function is the one reported
+    ClearTypeAssignState();
+    auto duplicate = makeManyFunctions(3);
+    duplicate.stmts.push_back(duplicate.stmts[1]);
+    auto duplicate_type = TypeAssign(duplicate);
+    REQUIRE(!duplicate_type.has_value());
+    REQUIRE(
+        duplicate_type.error().err == TypeAssignError::DuplicateDefinition
+    );
+}
+
+TEST_CASE("Assign program declares functions before defining them")
+{
+    // f1 is defined before its declaration, as in `f1 x = x + 1 fn f1 ...`
+    ClearTypeAssignState();
+    auto program = makeManyFunctions(2);
+    std::swap(program.stmts[2], program.stmts[3]);
+    auto types = TypeAssign(program);
+    REQUIRE(!types.has_value());
+    REQUIRE(types.error().err == TypeAssignError::UnknownType);
+    REQUIRE(!GetFunctionDefinitionTable().contains("f1"));
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Assign programs in separate states")
+{
+    // each state has its own definitions, so the same names check in both
+    ClearTypeAssignState();
+    auto first  = TypeAssignState{};
+    auto second = TypeAssignState{};
+    auto assign = [](TypeAssignState &state)
+    {
+        auto scope   = TypeAssignScope(state);
+        auto program = makeManyFunctions(3);
+        return TypeAssign(program).has_value();
+    };
+    REQUIRE(assign(first));
+    REQUIRE(assign(second));
+    REQUIRE(!assign(first));
+    REQUIRE(first.definitions.contains("f0"));
+    REQUIRE(!GetFunctionDefinitionTable().contains("f0"));
+}
+
 } // namespace xi
@@ -0,0 +1,53 @@
+#include "test_header.h"
+
+#include <compiler/functional/monad.h>
+#include <string>
+
+namespace xi
+{
+
+using ExpectedInt = tl::expected<int, std::string>;
+
+TEST_CASE("traverse collects values in order")
+{
+    auto input  = std::vector<int>{1, 2, 3};
+    auto result = traverse(
+        input,
+        [](int x) -> ExpectedInt
+        {
+            return x * 2;
+        }
+    );
+    REQUIRE(result.has_value());
+    REQUIRE(result.value() == std::vector<int>{2, 4, 6});
+}
+
+TEST_CASE("traverse stops at the first error")
+{
+    auto input   = std::vector<int>{1, 2, 3, 4};
+    auto visited = std::vector<int>{};
+    auto result  = traverse(
+        input,
+        [&visited](int x) -> ExpectedInt
+        {
+            visited.push_back(x);
+            if (x == 2)
+            {
+                return tl::make_unexpected(std::string("two"));
+            }
+            return x;
+        }
+    );
+    REQUIRE(!result.has_value());
+    REQUIRE(result.error() == "two");
+    REQUIRE(visited == std::vector<int>{1, 2});
+}
+
+TEST_CASE("sequence keeps order")
+{
+    auto result = sequence(std::vector<ExpectedInt>{1, 2, 3});
+    REQUIRE(result.has_value());
+    REQUIRE(result.value() == std::vector<int>{1, 2, 3});
+}
+
+} // namespace xi
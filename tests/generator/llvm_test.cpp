@@ -1,14 +1,1259 @@
 #include "test_header.h"
 
+#include <compiler/ast/type_assign.h>
+#include <compiler/generator/compiler_session.h>
+#include <compiler/generator/jit_session.h>
 #include <compiler/generator/llvm.h>
+#include <thread>
 
 namespace xi
 {
 TEST_CASE("Generate real")
 {
     // test llvm code generation
-    InitializeModule();
-    auto *codeGen = CodeGen(Xi_Real{1.0}).value();
+    auto cg = CodeGenContext{};
+    InitializeModule(cg);
+    auto *codeGen = CodeGen(Xi_Real{1.0}, cg).value();
     REQUIRE(codeGen != nullptr);
 }
+
+TEST_CASE("Generate from the function cache")
+{
+    auto cache = FunctionCache{};
+    auto cg    = CodeGenContext{};
+    ClearTypeAssignState();
+    auto program = makeCallerProgram(1);
+    REQUIRE(TypeAssign(program, cache).has_value());
+    // IR stored by the bare fingerprint, as an older compiler did, is not used
+    cache.StoreIR(cache.FingerprintOf("f").value(), "not IR");
+    auto cached = CodeGen(program, cache, cg);
+    REQUIRE(cached.has_value());
+    REQUIRE(cache.GetStats().ir_misses == 2);
+    REQUIRE(cached.value() == CodeGen(program, cg).value());
+
+    // only the edited function is generated again
+    ClearTypeAssignState();
+    auto edited = makeCallerProgram(2);
+    REQUIRE(TypeAssign(edited, cache).has_value());
+    auto regenerated = CodeGen(edited, cache, cg);
+    REQUIRE(regenerated.has_value());
+    REQUIRE(cache.GetStats().ir_hits == 1);
+    REQUIRE(cache.GetStats().ir_misses == 3);
+    REQUIRE(regenerated.value() == CodeGen(edited, cg).value());
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Optimize with the default pipelines")
+{
+    REQUIRE(ParseOptLevel("2").value() == llvm::OptimizationLevel::O2);
+    REQUIRE(ParseOptLevel("s").value() == llvm::OptimizationLevel::Os);
+    REQUIRE(!ParseOptLevel("4").has_value());
+
+    // inc x = let y = x + 2 in y - 1
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "inc", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "inc",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("y"), Xi_Integer{1}, Xi_Op::Sub},
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "y",
+                        .expr = Xi_Binop{iden("x"), Xi_Integer{2}, Xi_Op::Add},
+                    },
+                },
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    // parameters and lets are bound to their values, not kept in memory
+    auto unoptimized = CodeGen(program, cg);
+    REQUIRE(unoptimized.has_value());
+    REQUIRE(unoptimized.value().find("alloca") == std::string::npos);
+    REQUIRE(unoptimized.value().find("sub i64") != std::string::npos);
+    auto optimized = Optimize(llvm::OptimizationLevel::O2, cg);
+    REQUIRE(optimized.has_value());
+    REQUIRE(optimized.value().find("sub i64") == std::string::npos);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Run main in the JIT")
+{
+    // twice x = x + x, main = twice @ 21
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "twice", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "twice",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), iden("x"), Xi_Op::Add},
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr   = Xi_Call{.name = "twice", .args = {Xi_Integer{21}}},
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    for (auto lazy : {false, true})
+    {
+        REQUIRE(CodeGen(program, cg).has_value());
+        REQUIRE(JITRunMain(lazy, cg).value() == 42);
+    }
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Grow a JIT session one input at a time")
+{
+    auto session = JITSession::Create().value();
+
+    // next x = x + 1
+    auto first = Xi_Program{{
+        Xi_Decl{.name = "next", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "next",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), Xi_Integer{1}, Xi_Op::Add},
+        },
+    }};
+    REQUIRE(session.Define(first).has_value());
+    REQUIRE(
+        session.Evaluate(Xi_Call{.name = "next", .args = {Xi_Integer{41}}})
+            .value() == "42"
+    );
+
+    // a later input calls the earlier one
+    auto second = Xi_Program{{
+        Xi_Decl{.name = "twice", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "twice",
+            .params = {"x"},
+            .expr   = Xi_Call{
+                  .name = "next",
+                  .args = {Xi_Call{.name = "next", .args = {iden("x")}}},
+            },
+        },
+    }};
+    REQUIRE(session.Define(second).has_value());
+    REQUIRE(
+        session.Evaluate(Xi_Call{.name = "twice", .args = {Xi_Integer{1}}})
+            .value() == "3"
+    );
+    REQUIRE(session.Evaluate(Xi_Real{0.5}).value() == "0.5");
+    REQUIRE(session.Evaluate(Xi_Boolean{true}).value() == "true");
+
+    // redefinitions and unknown names are reported, the session carries on
+    REQUIRE(!session.Define(first).has_value());
+    REQUIRE(!session.Evaluate(iden("missing")).has_value());
+    REQUIRE(
+        session.Evaluate(Xi_Call{.name = "next", .args = {Xi_Integer{0}}})
+            .value() == "1"
+    );
+    // the session's definitions stay in the session
+    REQUIRE(!GetSymbolTable()[SymbolType::Function].contains("next"));
+
+    // apply x = let id = \y -> y in id @ x checks but cannot be generated,
+    // and leaves nothing behind that would stop it being defined again
+    auto lambda = Xi_Program{{
+        Xi_Decl{.name = "apply", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "apply",
+            .params = {"x"},
+            .expr   = Xi_Call{.name = "id", .args = {iden("x")}},
+            .let_idens =
+                {Xi_Iden{
+                    .name = "id",
+                    .expr = Xi_Lam{.args = {iden("y")}, .body = iden("y")},
+                }},
+        },
+    }};
+    REQUIRE(!session.Define(lambda).has_value());
+    REQUIRE(!session.Evaluate(Xi_Call{.name = "apply", .args = {Xi_Integer{1}}})
+                 .has_value());
+    auto apply = Xi_Program{{
+        Xi_Decl{.name = "apply", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "apply",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), Xi_Integer{2}, Xi_Op::Add},
+        },
+    }};
+    REQUIRE(session.Define(apply).has_value());
+    REQUIRE(
+        session.Evaluate(Xi_Call{.name = "apply", .args = {Xi_Integer{1}}})
+            .value() == "3"
+    );
+}
+
+TEST_CASE("Tune functions for the chosen CPU")
+{
+    auto native = ParseTargetCPU("native", "", "+sse2");
+    REQUIRE(native.cpu == llvm::sys::getHostCPUName().str());
+    REQUIRE(native.features.ends_with(",+sse2"));
+    REQUIRE(ParseTargetCPU("native", "generic", "") == TargetCPU{});
+
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "one", .return_type = "i64", .params_type = {}},
+        Xi_Func{.name = "one", .params = {}, .expr = Xi_Integer{1}},
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto cpuAttribute =
+        fmt::format("\"target-cpu\"=\"{}\"", llvm::sys::getHostCPUName());
+
+    SetTargetCPU(ParseTargetCPU("native", "", ""), cg);
+    REQUIRE(CodeGen(program, cg).has_value());
+    auto tuned = Optimize(llvm::OptimizationLevel::O0, cg);
+    REQUIRE(tuned.value().find(cpuAttribute) != std::string::npos);
+
+    SetTargetCPU({}, cg);
+    REQUIRE(CodeGen(program, cg).has_value());
+    auto generic = Optimize(llvm::OptimizationLevel::O0, cg);
+    REQUIRE(generic.value().find("target-cpu") == std::string::npos);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Emit objects in parallel partitions")
+{
+    auto program = makeCallerProgram(1);
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    REQUIRE(CodeGen(program, cg).has_value());
+
+    auto output  = std::filesystem::temp_directory_path() / "xi_parallel.o";
+    auto objects = GenObj(output.string(), 3, cg).value();
+    REQUIRE(objects.size() == 3);
+    REQUIRE(objects.front().ends_with("xi_parallel.0.o"));
+    for (const auto &object : objects)
+    {
+        REQUIRE(std::filesystem::file_size(object) > 0);
+        std::filesystem::remove(object);
+    }
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Compile in sessions on separate threads")
+{
+    // value = n, main = value @, with the same names in every program
+    auto makeProgram = [](int64_t n)
+    {
+        return Xi_Program{{
+            Xi_Decl{.name = "value", .return_type = "i64", .params_type = {}},
+            Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+            Xi_Func{.name = "value", .params = {}, .expr = Xi_Integer{n}},
+            Xi_Func{
+                .name   = "main",
+                .params = {},
+                .expr   = Xi_Call{.name = "value", .args = {}},
+            },
+        }};
+    };
+
+    auto results = std::vector<int64_t>(4, -1);
+    {
+        auto threads = std::vector<std::jthread>{};
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            threads.emplace_back(
+                [&makeProgram, &results, i]
+                {
+                    auto session = CompilerSession{};
+                    auto program = makeProgram(static_cast<int64_t>(i));
+                    if (session.TypeAssign(program) &&
+                        session.CodeGen(program) &&
+                        session.Optimize(llvm::OptimizationLevel::O2))
+                    {
+                        results[i] = session.JITRunMain(false).value_or(-1);
+                    }
+                }
+            );
+        }
+    }
+    REQUIRE(results == std::vector<int64_t>{0, 1, 2, 3});
+}
+
+TEST_CASE("Generate tail calls in constant stack")
+{
+    auto minusOne = [](const char *name)
+    {
+        return Xi_Binop{iden(name), Xi_Integer{1}, Xi_Op::Sub};
+    };
+    auto ifZero = [](Xi_Expr then, Xi_Expr els)
+    {
+        return Xi_If{
+            .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+            .then = std::move(then),
+            .els  = std::move(els),
+        };
+    };
+    // down n = if n == 0 then 0 else down @ n - 1, and the same through
+    // even and odd, main = down @ 10000000 + even @ 10000000
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "down", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "even", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "odd", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "down",
+            .params = {"n"},
+            .expr   = ifZero(
+                Xi_Integer{0}, Xi_Call{.name = "down", .args = {minusOne("n")}}
+            ),
+        },
+        Xi_Func{
+            .name   = "even",
+            .params = {"n"},
+            .expr   = ifZero(
+                Xi_Integer{1}, Xi_Call{.name = "odd", .args = {minusOne("n")}}
+            ),
+        },
+        Xi_Func{
+            .name   = "odd",
+            .params = {"n"},
+            .expr   = ifZero(
+                Xi_Integer{0}, Xi_Call{.name = "even", .args = {minusOne("n")}}
+            ),
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_Binop{
+                    Xi_Call{.name = "down", .args = {Xi_Integer{10000000}}},
+                    Xi_Call{.name = "even", .args = {Xi_Integer{10000000}}},
+                    Xi_Op::Add,
+                },
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    const auto &main_func =
+        std::get<recursive_wrapper<Xi_Func>>(program.stmts[7]).get();
+    REQUIRE(TailCalls(main_func).empty());
+
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(ir.find("tailrecurse") != std::string::npos);
+    REQUIRE(
+        ir.find("call fastcc i64 @down(i64 %subtmp)") == std::string::npos
+    );
+    REQUIRE(ir.find("musttail call fastcc i64 @odd") != std::string::npos);
+    REQUIRE(ir.find("musttail call fastcc i64 @even") != std::string::npos);
+    // only main is called from outside the module
+    REQUIRE(ir.find("define internal fastcc i64 @down(") != std::string::npos);
+    REQUIRE(ir.find("define i64 @main()") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Carry the length of arrays")
+{
+    auto numbers = Xi_Array{};
+    for (int64_t i = 0; i < 1000; i++)
+    {
+        numbers.elements.emplace_back(Xi_Integer{i});
+    }
+    // total xs i = if i == len @ xs then 0 else xs[i] + total @ xs (i + 1),
+    // main = total @ [0, 1, ..., 999] 0
+    auto program = Xi_Program{{
+        Xi_Decl{
+            .name        = "total",
+            .return_type = "i64",
+            .params_type = {"arr[i64]", "i64"},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "total",
+            .params = {"xs", "i"},
+            .expr =
+                Xi_If{
+                    .cond =
+                        Xi_Binop{
+                            iden("i"),
+                            Xi_Call{.name = "len", .args = {iden("xs")}},
+                            Xi_Op::Eq,
+                        },
+                    .then = Xi_Integer{0},
+                    .els =
+                        Xi_Binop{
+                            Xi_ArrayIndex{
+                                .array_var_name = "xs",
+                                .index          = iden("i"),
+                            },
+                            Xi_Call{
+                                .name = "total",
+                                .args =
+                                    {
+                                        iden("xs"),
+                                        Xi_Binop{
+                                            iden("i"),
+                                            Xi_Integer{1},
+                                            Xi_Op::Add,
+                                        },
+                                    },
+                            },
+                            Xi_Op::Add,
+                        },
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_Call{.name = "total", .args = {numbers, Xi_Integer{0}}},
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(
+        ir.find("define internal fastcc i64 @total({ i64*, i64 }") !=
+        std::string::npos
+    );
+    REQUIRE(JITRunMain(false, cg).value() == 499500);
+
+    // len takes an array
+    auto not_array = Xi_Expr{Xi_Call{.name = "len", .args = {Xi_Integer{1}}}};
+    REQUIRE(!TypeAssign(not_array).has_value());
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Keep non-escaping arrays in the frame")
+{
+    auto call = [](const char *name, Xi_Expr arg)
+    {
+        return Xi_Call{.name = name, .args = {std::move(arg)}};
+    };
+    auto array = [](std::vector<int64_t> values)
+    {
+        auto arr = Xi_Array{};
+        for (auto value : values)
+        {
+            arr.elements.emplace_back(Xi_Integer{value});
+        }
+        return arr;
+    };
+    // first xs = xs[0], same xs = xs,
+    // main = let ys = [1, 2, 3]
+    //        in first @ ys + first @ [4, 5] + len @ (same @ [6, 7, 8, 9])
+    auto program = Xi_Program{{
+        Xi_Decl{
+            .name        = "first",
+            .return_type = "i64",
+            .params_type = {"arr[i64]"},
+        },
+        Xi_Decl{
+            .name        = "same",
+            .return_type = "arr[i64]",
+            .params_type = {"arr[i64]"},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "first",
+            .params = {"xs"},
+            .expr =
+                Xi_ArrayIndex{.array_var_name = "xs", .index = Xi_Integer{0}},
+        },
+        Xi_Func{.name = "same", .params = {"xs"}, .expr = iden("xs")},
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_Binop{
+                    Xi_Binop{
+                        call("first", iden("ys")),
+                        call("first", array({4, 5})),
+                        Xi_Op::Add,
+                    },
+                    call("len", call("same", array({6, 7, 8, 9}))),
+                    Xi_Op::Add,
+                },
+            .let_idens = {Xi_Iden{.name = "ys", .expr = array({1, 2, 3})}},
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(ir.find("alloca { i64, [3 x i64] }") != std::string::npos);
+    REQUIRE(ir.find("alloca { i64, [2 x i64] }") != std::string::npos);
+    // only the array same returns is on the heap
+    auto heap = ir.find("call i8* @malloc");
+    REQUIRE(heap != std::string::npos);
+    REQUIRE(ir.find("call i8* @malloc", heap + 1) == std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 9);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Count references to arrays and reuse the last one")
+{
+    auto index = [](const char *name, int64_t i)
+    {
+        return Xi_ArrayIndex{.array_var_name = name, .index = Xi_Integer{i}};
+    };
+    auto pair = [](Xi_Expr first, Xi_Expr second)
+    {
+        return Xi_Array{.elements = {std::move(first), std::move(second)}};
+    };
+    // step fib = [fib[1], fib[0] + fib[1]],
+    // iterate fib n = if n == 0 then fib else iterate @ (step @ fib) (n - 1),
+    // second rows = let row = rows[1] in row[0],
+    // main = let fib = iterate @ [0, 1] 90
+    //        in fib[0] - second @ [[1, 2], [3, 4]]
+    auto program = Xi_Program{{
+        Xi_Decl{
+            .name        = "step",
+            .return_type = "arr[i64]",
+            .params_type = {"arr[i64]"},
+        },
+        Xi_Decl{
+            .name        = "iterate",
+            .return_type = "arr[i64]",
+            .params_type = {"arr[i64]", "i64"},
+        },
+        Xi_Decl{
+            .name        = "second",
+            .return_type = "i64",
+            .params_type = {"arr[arr[i64]]"},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "step",
+            .params = {"fib"},
+            .expr   = pair(
+                index("fib", 1),
+                Xi_Binop{index("fib", 0), index("fib", 1), Xi_Op::Add}
+            ),
+        },
+        Xi_Func{
+            .name   = "iterate",
+            .params = {"fib", "n"},
+            .expr =
+                Xi_If{
+                    .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+                    .then = iden("fib"),
+                    .els =
+                        Xi_Call{
+                            .name = "iterate",
+                            .args =
+                                {
+                                    Xi_Call{
+                                        .name = "step",
+                                        .args = {iden("fib")},
+                                    },
+                                    Xi_Binop{
+                                        iden("n"),
+                                        Xi_Integer{1},
+                                        Xi_Op::Sub,
+                                    },
+                                },
+                        },
+                },
+        },
+        Xi_Func{
+            .name      = "second",
+            .params    = {"rows"},
+            .expr      = index("row", 0),
+            .let_idens = {Xi_Iden{.name = "row", .expr = index("rows", 1)}},
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_Binop{
+                    index("fib", 0),
+                    Xi_Call{
+                        .name = "second",
+                        .args =
+                            {pair(
+                                pair(Xi_Integer{1}, Xi_Integer{2}),
+                                pair(Xi_Integer{3}, Xi_Integer{4})
+                            )},
+                    },
+                    Xi_Op::Sub,
+                },
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "fib",
+                        .expr =
+                            Xi_Call{
+                                .name = "iterate",
+                                .args = {pair(Xi_Integer{0}, Xi_Integer{1}),
+                                         Xi_Integer{90}},
+                            },
+                    },
+                },
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    // step takes over the array it is given when nothing else refers to it
+    REQUIRE(ir.find("reuse:") != std::string::npos);
+    REQUIRE(ir.find("call void @free(") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 2880067194370816120 - 3);
+
+    // loop n = let xss = [[n]] in if n == 0 then len @ xss
+    //          else loop @ (n - 1),
+    // main = loop @ 1000
+    // xss does not escape, but the array in it must still be freed
+    auto nested = Xi_Program{{
+        Xi_Decl{.name = "loop", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "loop",
+            .params = {"n"},
+            .expr =
+                Xi_If{
+                    .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+                    .then = Xi_Call{.name = "len", .args = {iden("xss")}},
+                    .els =
+                        Xi_Call{
+                            .name = "loop",
+                            .args = {Xi_Binop{
+                                iden("n"),
+                                Xi_Integer{1},
+                                Xi_Op::Sub,
+                            }},
+                        },
+                },
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "xss",
+                        .expr =
+                            Xi_Array{.elements = {Xi_Array{
+                                         .elements = {iden("n")},
+                                     }}},
+                    },
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr   = Xi_Call{.name = "loop", .args = {Xi_Integer{1000}}},
+        },
+    }};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(nested).has_value());
+    auto nested_ir = CodeGen(nested, cg).value();
+    REQUIRE(nested_ir.find("alloca { i64, [1 x") == std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+
+    // a statement function drops what its vars and parameters held:
+    // fill xs n {
+    //     var ys: arr[i64] = xs; var i: i64 = 0;
+    //     while (i < n) { ys = [i, i + 1]; i = i + 1; }
+    //     return ys[1] + xs[0];
+    // },
+    // main = fill @ [5, 6] 1000
+    auto assign = [](const char *name, Xi_Expr expr) -> Xi_Stmt
+    {
+        return Xi_Expr{Xi_Assign{.name = name, .expr = std::move(expr)}};
+    };
+    auto increment  = Xi_Binop{iden("i"), Xi_Integer{1}, Xi_Op::Add};
+    auto statements = Xi_Program{{
+        Xi_Decl{
+            .name        = "fill",
+            .return_type = "i64",
+            .params_type = {"arr[i64]", "i64"},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "fill",
+            .params = {"xs", "n"},
+            .expr   = std::monostate{},
+            .stmts =
+                {
+                    Xi_Var{
+                        .name      = "ys",
+                        .value     = iden("xs"),
+                        .type_name = "arr[i64]",
+                    },
+                    Xi_Var{
+                        .name      = "i",
+                        .value     = Xi_Integer{0},
+                        .type_name = "i64",
+                    },
+                    Xi_While{
+                        .cond = Xi_Binop{iden("i"), iden("n"), Xi_Op::Lt},
+                        .body =
+                            {
+                                assign("ys", pair(iden("i"), increment)),
+                                assign("i", increment),
+                            },
+                    },
+                    Xi_Return{
+                        .expr =
+                            Xi_Binop{
+                                index("ys", 1),
+                                index("xs", 0),
+                                Xi_Op::Add,
+                            },
+                    },
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_Call{
+                    .name = "fill",
+                    .args = {pair(Xi_Integer{5}, Xi_Integer{6}),
+                             Xi_Integer{1000}},
+                },
+        },
+    }};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(statements).has_value());
+    auto statements_ir = CodeGen(statements, cg).value();
+    auto fill_at       = statements_ir.find("@fill(");
+    auto fill          = statements_ir.substr(
+        fill_at, statements_ir.find("\n}\n", fill_at) - fill_at
+    );
+    REQUIRE(fill.find("call void @xi.drop") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1000 + 5);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Allocate arrays from an arena")
+{
+    REQUIRE(ParseAllocMode("arena").value() == AllocMode::Arena);
+    REQUIRE(!ParseAllocMode("gc").has_value());
+
+    // triple n = [n, n + 1, n + 2], last xs = xs[2],
+    // total n = if n == 0 then 0 else last @ (triple @ n) + total @ (n - 1),
+    // main = total @ 100000
+    auto program = Xi_Program{{
+        Xi_Decl{
+            .name        = "triple",
+            .return_type = "arr[i64]",
+            .params_type = {"i64"},
+        },
+        Xi_Decl{
+            .name        = "last",
+            .return_type = "i64",
+            .params_type = {"arr[i64]"},
+        },
+        Xi_Decl{.name = "total", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "triple",
+            .params = {"n"},
+            .expr =
+                Xi_Array{
+                    .elements =
+                        {
+                            iden("n"),
+                            Xi_Binop{iden("n"), Xi_Integer{1}, Xi_Op::Add},
+                            Xi_Binop{iden("n"), Xi_Integer{2}, Xi_Op::Add},
+                        },
+                },
+        },
+        Xi_Func{
+            .name   = "last",
+            .params = {"xs"},
+            .expr =
+                Xi_ArrayIndex{.array_var_name = "xs", .index = Xi_Integer{2}},
+        },
+        Xi_Func{
+            .name   = "total",
+            .params = {"n"},
+            .expr =
+                Xi_If{
+                    .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+                    .then = Xi_Integer{0},
+                    .els =
+                        Xi_Binop{
+                            Xi_Call{
+                                .name = "last",
+                                .args = {Xi_Call{
+                                    .name = "triple",
+                                    .args = {iden("n")},
+                                }},
+                            },
+                            Xi_Call{
+                                .name = "total",
+                                .args = {Xi_Binop{
+                                    iden("n"),
+                                    Xi_Integer{1},
+                                    Xi_Op::Sub,
+                                }},
+                            },
+                            Xi_Op::Add,
+                        },
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr   = Xi_Call{.name = "total", .args = {Xi_Integer{100000}}},
+        },
+    }};
+    auto cached_program = program;
+    auto cg             = CodeGenContext{};
+    cg.alloc_mode       = AllocMode::Arena;
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(ir.find("call i8* @xi.arena.alloc(") != std::string::npos);
+    // arena arrays are never freed, so nothing counts their references
+    REQUIRE(ir.find("@malloc(") == std::string::npos);
+    REQUIRE(ir.find("@xi.drop") == std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 5000250000);
+
+    // IR cached in one mode is not reused in the other
+    auto cache = FunctionCache{};
+    auto heap  = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(cached_program, cache).has_value());
+    auto heap_ir = CodeGen(cached_program, cache, heap).value();
+    REQUIRE(heap_ir.find("@malloc(") != std::string::npos);
+    auto arena_ir = CodeGen(cached_program, cache, cg).value();
+    REQUIRE(arena_ir.find("@malloc(") == std::string::npos);
+    REQUIRE(cache.GetStats().ir_hits == 0);
+    REQUIRE(CodeGen(cached_program, cache, cg).value() == arena_ir);
+    REQUIRE(cache.GetStats().ir_hits == 4);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Pass and return large sets through memory")
+{
+    auto member = [](const char *set, const char *name)
+    {
+        return Xi_Binop{.lhs = iden(set), .rhs = iden(name), .op = Xi_Op::Dot};
+    };
+    // shift v n = if n == 0 then v
+    //             else shift @ (vec @ v.y v.z (v.x + 1)) (n - 1),
+    // last v n = shift @ v n, sum v = v.x + v.y + v.z,
+    // main = let v = last @ (vec @ 1 2 3) 100000 in sum @ v
+    auto program = Xi_Program{{
+        Xi_Set{
+            .name    = "vec",
+            .members = {{"x", "i64"}, {"y", "i64"}, {"z", "i64"}},
+        },
+        Xi_Decl{
+            .name        = "shift",
+            .return_type = "vec",
+            .params_type = {"vec", "i64"},
+        },
+        Xi_Decl{
+            .name        = "last",
+            .return_type = "vec",
+            .params_type = {"vec", "i64"},
+        },
+        Xi_Decl{.name = "sum", .return_type = "i64", .params_type = {"vec"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "shift",
+            .params = {"v", "n"},
+            .expr =
+                Xi_If{
+                    .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+                    .then = iden("v"),
+                    .els =
+                        Xi_Call{
+                            .name = "shift",
+                            .args =
+                                {
+                                    Xi_Call{
+                                        .name = "vec",
+                                        .args =
+                                            {
+                                                member("v", "y"),
+                                                member("v", "z"),
+                                                Xi_Binop{
+                                                    member("v", "x"),
+                                                    Xi_Integer{1},
+                                                    Xi_Op::Add,
+                                                },
+                                            },
+                                    },
+                                    Xi_Binop{
+                                        iden("n"),
+                                        Xi_Integer{1},
+                                        Xi_Op::Sub,
+                                    },
+                                },
+                        },
+                },
+        },
+        Xi_Func{
+            .name   = "last",
+            .params = {"v", "n"},
+            .expr   = Xi_Call{.name = "shift", .args = {iden("v"), iden("n")}},
+        },
+        Xi_Func{
+            .name   = "sum",
+            .params = {"v"},
+            .expr =
+                Xi_Binop{
+                    Xi_Binop{member("v", "x"), member("v", "y"), Xi_Op::Add},
+                    member("v", "z"),
+                    Xi_Op::Add,
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr   = Xi_Call{.name = "sum", .args = {iden("v")}},
+            .let_idens =
+                {
+                    Xi_Iden{
+                        .name = "v",
+                        .expr =
+                            Xi_Call{
+                                .name = "last",
+                                .args =
+                                    {
+                                        Xi_Call{
+                                            .name = "vec",
+                                            .args = {Xi_Integer{1},
+                                                     Xi_Integer{2},
+                                                     Xi_Integer{3}},
+                                        },
+                                        Xi_Integer{100000},
+                                    },
+                            },
+                    },
+                },
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    // the constructor and functions build the set where their caller wants
+    // it, and members are read without loading the rest
+    auto sret = std::string{"%vec* noalias nocapture writeonly sret(%vec)"};
+    REQUIRE(
+        ir.find("define internal fastcc void @vec(" + sret) !=
+        std::string::npos
+    );
+    REQUIRE(
+        ir.find("call fastcc void @last(" + sret + " %v") != std::string::npos
+    );
+    REQUIRE(
+        ir.find("musttail call fastcc void @shift(" + sret + " %result") !=
+        std::string::npos
+    );
+    REQUIRE(ir.find("getelementptr inbounds %vec") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 100006);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Lower real arithmetic")
+{
+    // half x = x / 2.0, main = if -(half @ 5.0) < -2.0 then 1 else 0
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "half", .return_type = "real", .params_type = {"real"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "half",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), Xi_Real{2.0}, Xi_Op::Div},
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_If{
+                    .cond =
+                        Xi_Binop{
+                            Xi_Unop{
+                                .expr =
+                                    Xi_Call{
+                                        .name = "half",
+                                        .args = {Xi_Real{5.0}},
+                                    },
+                                .op = Xi_Op::Sub,
+                            },
+                            Xi_Unop{.expr = Xi_Real{2.0}, .op = Xi_Op::Sub},
+                            Xi_Op::Lt,
+                        },
+                    .then = Xi_Integer{1},
+                    .els  = Xi_Integer{0},
+                },
+        },
+    }};
+    auto cached_program = program;
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto cg = CodeGenContext{};
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(ir.find("fdiv double") != std::string::npos);
+    REQUIRE(ir.find("fneg double") != std::string::npos);
+    REQUIRE(ir.find("fcmp olt double") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+
+    // fast math lets the optimizer treat it as exact
+    auto fast = CodeGenContext{};
+    fast.fast_math = true;
+    REQUIRE(CodeGen(program, fast).value().find("fdiv fast double") !=
+            std::string::npos);
+
+    // and is part of the key of the cached IR, both ways
+    auto cache = FunctionCache{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(cached_program, cache).has_value());
+    REQUIRE(CodeGen(cached_program, cache, fast).value().find("fdiv fast") !=
+            std::string::npos);
+    REQUIRE(CodeGen(cached_program, cache, cg).value().find("fdiv fast") ==
+            std::string::npos);
+    REQUIRE(cache.GetStats().ir_hits == 0);
+
+    // statement functions negate reals too:
+    // twice x { var y: real = -x; return -(y - x); },
+    // main = if twice @ 1.5 > 2.5 then 1 else 0
+    auto statements = Xi_Program{{
+        Xi_Decl{
+            .name        = "twice",
+            .return_type = "real",
+            .params_type = {"real"},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "twice",
+            .params = {"x"},
+            .expr   = std::monostate{},
+            .stmts =
+                {
+                    Xi_Var{
+                        .name      = "y",
+                        .value =
+                            Xi_Unop{.expr = iden("x"), .op = Xi_Op::Sub},
+                        .type_name = "real",
+                    },
+                    Xi_Return{
+                        .expr =
+                            Xi_Unop{
+                                .expr =
+                                    Xi_Binop{iden("y"), iden("x"), Xi_Op::Sub},
+                                .op = Xi_Op::Sub,
+                            },
+                    },
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_If{
+                    .cond =
+                        Xi_Binop{
+                            Xi_Call{.name = "twice", .args = {Xi_Real{1.5}}},
+                            Xi_Real{2.5},
+                            Xi_Op::Gt,
+                        },
+                    .then = Xi_Integer{1},
+                    .els  = Xi_Integer{0},
+                },
+        },
+    }};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(statements).has_value());
+    auto statements_ir = CodeGen(statements, cg).value();
+    REQUIRE(statements_ir.find("fneg double") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Short-circuit && and ||")
+{
+    auto equal = [](Xi_Expr lhs, Xi_Expr rhs)
+    {
+        return Xi_Binop{std::move(lhs), std::move(rhs), Xi_Op::Eq};
+    };
+    auto boom = Xi_Call{.name = "boom", .args = {Xi_Integer{0}}};
+    // boom n = 1 + boom @ n never returns, so
+    // main = if (1 == 2 && boom @ 0 == 1) || (1 == 1 || boom @ 0 == 1)
+    //        then 1 else 0
+    // only returns if neither right side runs
+    auto program = Xi_Program{{
+        Xi_Decl{.name = "boom", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "boom",
+            .params = {"n"},
+            .expr =
+                Xi_Binop{
+                    Xi_Integer{1},
+                    Xi_Call{.name = "boom", .args = {iden("n")}},
+                    Xi_Op::Add,
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_If{
+                    .cond =
+                        Xi_Binop{
+                            Xi_Binop{
+                                equal(Xi_Integer{1}, Xi_Integer{2}),
+                                equal(boom, Xi_Integer{1}),
+                                Xi_Op::And,
+                            },
+                            Xi_Binop{
+                                equal(Xi_Integer{1}, Xi_Integer{1}),
+                                equal(boom, Xi_Integer{1}),
+                                Xi_Op::Or,
+                            },
+                            Xi_Op::Or,
+                        },
+                    .then = Xi_Integer{1},
+                    .els  = Xi_Integer{0},
+                },
+        },
+    }};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto cg = CodeGenContext{};
+    auto ir = CodeGen(program, cg).value();
+    REQUIRE(ir.find("logiccont") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Mark what functions may do")
+{
+    // tick is only declared, square x = x * x, twice x = square @ square @ x,
+    // spin n = if n == 0 then 0 else spin @ n - 1, noisy x = tick @ x
+    auto program = Xi_Program{{
+        Xi_Set{.name = "pair", .members = {{"x", "i64"}, {"y", "i64"}}},
+        Xi_Decl{.name = "tick", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{
+            .name        = "square",
+            .return_type = "i64",
+            .params_type = {"i64"},
+        },
+        Xi_Decl{.name = "twice", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "spin", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "noisy", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "square",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), iden("x"), Xi_Op::Mul},
+        },
+        Xi_Func{
+            .name   = "twice",
+            .params = {"x"},
+            .expr =
+                Xi_Call{
+                    .name = "square",
+                    .args = {Xi_Call{.name = "square", .args = {iden("x")}}},
+                },
+        },
+        Xi_Func{
+            .name   = "spin",
+            .params = {"n"},
+            .expr =
+                Xi_If{
+                    .cond = Xi_Binop{iden("n"), Xi_Integer{0}, Xi_Op::Eq},
+                    .then = Xi_Integer{0},
+                    .els =
+                        Xi_Call{
+                            .name = "spin",
+                            .args = {Xi_Binop{
+                                iden("n"),
+                                Xi_Integer{1},
+                                Xi_Op::Sub,
+                            }},
+                        },
+                },
+        },
+        Xi_Func{
+            .name   = "noisy",
+            .params = {"x"},
+            .expr   = Xi_Call{.name = "tick", .args = {iden("x")}},
+        },
+    }};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto cg = CodeGenContext{};
+    REQUIRE(CodeGen(program, cg).has_value());
+    auto function = [&cg](const char *name)
+    {
+        return cg.module->getFunction(name);
+    };
+    for (const auto *name : {"pair", "square", "twice"})
+    {
+        REQUIRE(function(name)->doesNotAccessMemory());
+        REQUIRE(function(name)->willReturn());
+        REQUIRE(function(name)->doesNotThrow());
+    }
+    // spin may recurse forever, noisy may do anything tick does
+    REQUIRE(function("spin")->doesNotAccessMemory());
+    REQUIRE(!function("spin")->willReturn());
+    REQUIRE(!function("noisy")->doesNotAccessMemory());
+    REQUIRE(!function("noisy")->willReturn());
+    REQUIRE(function("noisy")->doesNotThrow());
+    REQUIRE(!function("tick")->doesNotThrow());
+    ClearTypeAssignState();
+}
+
+TEST_CASE("Tag the memory of arrays for alias analysis")
+{
+    auto index = [](const char *name, int64_t i)
+    {
+        return Xi_ArrayIndex{.array_var_name = name, .index = Xi_Integer{i}};
+    };
+    // flags = [true, false, true],
+    // main = let fs = flags @ in if fs[1] then 0 else if fs[2] then 1 else 0
+    auto program = Xi_Program{{
+        Xi_Decl{
+            .name        = "flags",
+            .return_type = "arr[buer]",
+            .params_type = {},
+        },
+        Xi_Decl{.name = "main", .return_type = "i64", .params_type = {}},
+        Xi_Func{
+            .name   = "flags",
+            .params = {},
+            .expr =
+                Xi_Array{
+                    .elements = {Xi_Boolean{true},
+                                 Xi_Boolean{false},
+                                 Xi_Boolean{true}},
+                },
+        },
+        Xi_Func{
+            .name   = "main",
+            .params = {},
+            .expr =
+                Xi_If{
+                    .cond = index("fs", 1),
+                    .then = Xi_Integer{0},
+                    .els =
+                        Xi_If{
+                            .cond = index("fs", 2),
+                            .then = Xi_Integer{1},
+                            .els  = Xi_Integer{0},
+                        },
+                },
+            .let_idens =
+                {Xi_Iden{.name = "fs", .expr = Xi_Call{.name = "flags"}}},
+        },
+    }};
+    auto cg = CodeGenContext{};
+    ClearTypeAssignState();
+    REQUIRE(TypeAssign(program).has_value());
+    auto ir = CodeGen(program, cg).value();
+    // elements and counts are told apart, and a buer is loaded as an i1
+    REQUIRE(ir.find("load i1, i1* %element_ptr") != std::string::npos);
+    REQUIRE(ir.find("!tbaa") != std::string::npos);
+    REQUIRE(ir.find("!{!\"i1\", ") != std::string::npos);
+    REQUIRE(ir.find("!{!\"count\", ") != std::string::npos);
+    REQUIRE(JITRunMain(false, cg).value() == 1);
+    ClearTypeAssignState();
+}
 } // namespace xi
@@ -8,6 +8,36 @@
 #include <catch2/matchers/catch_matchers_templated.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+namespace xi
+{
+
+// a use of the name, as the parser builds it
+inline auto iden(const char *name) -> Xi_Iden
+{
+    return Xi_Iden{.name = name, .expr = std::monostate{}};
+}
+
+// f x = x + step, g x = f @ x
+inline auto makeCallerProgram(int64_t step) -> Xi_Program
+{
+    return Xi_Program{{
+        Xi_Decl{.name = "f", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Decl{.name = "g", .return_type = "i64", .params_type = {"i64"}},
+        Xi_Func{
+            .name   = "f",
+            .params = {"x"},
+            .expr   = Xi_Binop{iden("x"), Xi_Integer{step}, Xi_Op::Add},
+        },
+        Xi_Func{
+            .name   = "g",
+            .params = {"x"},
+            .expr   = Xi_Call{.name = "f", .args = {iden("x")}},
+        },
+    }};
+}
+
+} // namespace xi
+
 namespace Catch
 {
 
@@ -0,0 +1,42 @@
+#include <catch2/catch_test_macros.hpp>
+#include <compiler/utils/scoped_table.h>
+#include <string>
+
+namespace xi
+{
+
+TEST_CASE("ScopedTable lookup and shadow")
+{
+    auto table = ScopedTable<std::string, int>{};
+    REQUIRE(table.find("x") == nullptr);
+
+    table.insert_or_assign("x", 1);
+    REQUIRE(table.contains("x"));
+    REQUIRE(*table.find("x") == 1);
+
+    auto inner = table.Extend();
+    inner.insert_or_assign("x", 2);
+    REQUIRE(*inner.find("x") == 2);
+    REQUIRE(*table.find("x") == 1);
+
+    REQUIRE(!inner.insert({"x", 3}));
+    REQUIRE(*inner.find("x") == 2);
+}
+
+TEST_CASE("ScopedTable copies share without leaking")
+{
+    auto table = ScopedTable<std::string, int>{};
+    table.insert_or_assign("x", 1);
+
+    auto copy = table;
+    copy.insert_or_assign("y", 2);
+    REQUIRE(copy.contains("x"));
+    REQUIRE(copy.contains("y"));
+    REQUIRE(!table.contains("y"));
+
+    table.insert_or_assign("z", 3);
+    REQUIRE(table.contains("z"));
+    REQUIRE(!copy.contains("z"));
+}
+
+} // namespace xi
@@ -0,0 +1,59 @@
+#include <catch2/catch_test_macros.hpp>
+#include <compiler/utils/symbol.h>
+#include <string>
+#include <vector>
+
+namespace xi
+{
+
+TEST_CASE("Symbol interning")
+{
+    auto a = Symbol{"foo"};
+    auto b = Symbol{std::string("foo")};
+    auto c = Symbol{"bar"};
+    REQUIRE(a == b);
+    REQUIRE(a.id() == b.id());
+    REQUIRE(a != c);
+    REQUIRE(a.str() == "foo");
+    REQUIRE(Symbol{}.id() == 0);
+    REQUIRE(Symbol{}.empty());
+}
+
+TEST_CASE("Symbol text stays put as more names are interned")
+{
+    // enough names to fill several chunks of the interner
+    auto symbols = std::vector<Symbol>{};
+    for (size_t i = 0; i < 10000; i++)
+    {
+        symbols.emplace_back(fmt::format("name{}", i));
+    }
+    const auto *first = &symbols.front().str();
+    for (size_t i = 0; i < 10000; i++)
+    {
+        REQUIRE(symbols[i].str() == fmt::format("name{}", i));
+        REQUIRE(Symbol{fmt::format("name{}", i)} == symbols[i]);
+    }
+    REQUIRE(&symbols.front().str() == first);
+}
+
+TEST_CASE("SymbolMap insert and clear")
+{
+    auto map = SymbolMap<int>{};
+    REQUIRE(map.find("x") == nullptr);
+
+    REQUIRE(map.insert("x", 1));
+    REQUIRE(!map.insert("x", 2));
+    REQUIRE(*map.find("x") == 1);
+
+    map.insert_or_assign("x", 3);
+    map.insert_or_assign("y", 4);
+    REQUIRE(*map.find("x") == 3);
+    REQUIRE(map.size() == 2);
+
+    map.clear();
+    REQUIRE(map.empty());
+    REQUIRE(!map.contains("x"));
+    REQUIRE(!map.contains("y"));
+}
+
+} // namespace xi
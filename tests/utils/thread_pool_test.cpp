@@ -0,0 +1,75 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <compiler/utils/thread_pool.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace xi
+{
+
+TEST_CASE("ThreadPool Submit returns the task result")
+{
+    auto pool   = ThreadPool{2};
+    auto answer = pool.Submit(
+        []
+        {
+            return 42;
+        }
+    );
+    REQUIRE(answer.get() == 42);
+}
+
+TEST_CASE("ThreadPool ParallelFor visits every index once")
+{
+    auto pool   = ThreadPool{4};
+    auto visits = std::vector<std::atomic<int>>(1000);
+    pool.ParallelFor(
+        visits.size(),
+        [&visits](size_t i)
+        {
+            visits[i]++;
+        }
+    );
+    for (const auto &visit : visits)
+    {
+        REQUIRE(visit == 1);
+    }
+
+    // nothing to do is not an error
+    pool.ParallelFor(
+        0,
+        [](size_t)
+        {
+            FAIL("called for an empty range");
+        }
+    );
+}
+
+TEST_CASE("ThreadPool ParallelFor waits for every helper before throwing")
+{
+    auto pool     = ThreadPool{4};
+    auto running  = std::atomic<int>{0};
+    auto parallel = [&pool, &running]
+    {
+        pool.ParallelFor(
+            64,
+            [&running](size_t i)
+            {
+                running++;
+                if (i == 0)
+                {
+                    running--;
+                    throw std::runtime_error("failed");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                running--;
+            }
+        );
+    };
+    REQUIRE_THROWS_AS(parallel(), std::runtime_error);
+    REQUIRE(running == 0);
+}
+
+} // namespace xi